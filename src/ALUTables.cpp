@@ -0,0 +1,5 @@
+#include "CPU.h"
+
+// constexpr so this has to be built by the compiler, it never runs at startup.
+// MSVC needs /constexpr:steps raised for it (set in the project file).
+constexpr ALUTables aluTables = ALUTables::Make();
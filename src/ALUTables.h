@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+
+Lookup tables for the 8 bit ALU.
+
+Every entry is (result << 8) | F so one load gives the new register value and all four flags.
+The Add/Sub/Inc/Dec/Daa functions are what the tables are built from, they're constexpr so the
+whole thing is worked out by the compiler. They can also be called at runtime (GB_ALU_TABLES=0).
+
+    add[carry][a][b] = a + b + carry
+    sub[carry][a][b] = a - b - carry, CP uses this too and only keeps F
+    inc[a] / dec[a]  = a + 1 / a - 1, C is left clear since the caller has to keep the old one
+    daa[nhc][a]      = DAA where nhc is the N, H and C flags (F >> 4)
+
+*/
+
+struct ALUTables
+{
+    static constexpr uint8_t Z = 0x80;
+    static constexpr uint8_t N = 0x40;
+    static constexpr uint8_t H = 0x20;
+    static constexpr uint8_t C = 0x10;
+
+    uint16_t add[2][256][256];
+    uint16_t sub[2][256][256];
+    uint16_t inc[256];
+    uint16_t dec[256];
+    uint16_t daa[8][256];
+
+    static constexpr uint16_t Add(uint8_t a, uint8_t b, uint8_t carry)
+    {
+        unsigned result = a + b + carry;
+        unsigned f = ((result & 0xFF) == 0 ? Z : 0)
+            | (((a & 0x0F) + (b & 0x0F) + carry) > 0x0F ? H : 0)
+            | (result > 0xFF ? C : 0);
+        return static_cast<uint16_t>(((result & 0xFF) << 8) | f);
+    }
+
+    static constexpr uint16_t Sub(uint8_t a, uint8_t b, uint8_t carry)
+    {
+        unsigned result = (a - b - carry) & 0xFF;
+        unsigned f = (result == 0 ? Z : 0) | N
+            | ((a & 0x0F) < (b & 0x0F) + carry ? H : 0)
+            | (a < b + carry ? C : 0);
+        return static_cast<uint16_t>((result << 8) | f);
+    }
+
+    static constexpr uint16_t Inc(uint8_t a)
+    {
+        unsigned result = (a + 1) & 0xFF;
+        unsigned f = (result == 0 ? Z : 0) | ((a & 0x0F) == 0x0F ? H : 0);
+        return static_cast<uint16_t>((result << 8) | f);
+    }
+
+    static constexpr uint16_t Dec(uint8_t a)
+    {
+        unsigned result = (a - 1) & 0xFF;
+        unsigned f = (result == 0 ? Z : 0) | N | ((a & 0x0F) == 0x00 ? H : 0);
+        return static_cast<uint16_t>((result << 8) | f);
+    }
+
+    static constexpr uint16_t Daa(uint8_t a, uint8_t nhc)
+    {
+        bool n = (nhc & 0x04) != 0;
+        bool h = (nhc & 0x02) != 0;
+        bool c = (nhc & 0x01) != 0;
+
+        unsigned correction = 0;
+        if (h || (!n && (a & 0x0F) > 0x09)) {
+            correction |= 0x06;
+        }
+        if (c || (!n && a > 0x99)) {
+            correction |= 0x60;
+            c = true;
+        }
+
+        unsigned result = (n ? a - correction : a + correction) & 0xFF;
+        unsigned f = (result == 0 ? Z : 0) | (n ? N : 0) | (c ? C : 0); // H always ends up clear
+        return static_cast<uint16_t>((result << 8) | f);
+    }
+
+    static constexpr ALUTables Make()
+    {
+        ALUTables t{};
+
+        for (unsigned a = 0; a < 256; a++) {
+            for (unsigned b = 0; b < 256; b++) {
+                for (unsigned carry = 0; carry < 2; carry++) {
+                    t.add[carry][a][b] = Add(a, b, carry);
+                    t.sub[carry][a][b] = Sub(a, b, carry);
+                }
+            }
+
+            t.inc[a] = Inc(a);
+            t.dec[a] = Dec(a);
+
+            for (unsigned nhc = 0; nhc < 8; nhc++) {
+                t.daa[nhc][a] = Daa(a, nhc);
+            }
+        }
+
+        return t;
+    }
+};
+
+extern const ALUTables aluTables; // ALUTables.cpp
+
+// These are what the handlers call, GB_ALU_TABLES picks between the tables and working it out each time
+inline uint16_t AluAdd(uint8_t a, uint8_t b, uint8_t carry)
+{
+#if GB_ALU_TABLES
+    return aluTables.add[carry][a][b];
+#else
+    return ALUTables::Add(a, b, carry);
+#endif
+}
+
+inline uint16_t AluSub(uint8_t a, uint8_t b, uint8_t carry)
+{
+#if GB_ALU_TABLES
+    return aluTables.sub[carry][a][b];
+#else
+    return ALUTables::Sub(a, b, carry);
+#endif
+}
+
+inline uint16_t AluInc(uint8_t a)
+{
+#if GB_ALU_TABLES
+    return aluTables.inc[a];
+#else
+    return ALUTables::Inc(a);
+#endif
+}
+
+inline uint16_t AluDec(uint8_t a)
+{
+#if GB_ALU_TABLES
+    return aluTables.dec[a];
+#else
+    return ALUTables::Dec(a);
+#endif
+}
+
+inline uint16_t AluDaa(uint8_t a, uint8_t nhc)
+{
+#if GB_ALU_TABLES
+    return aluTables.daa[nhc & 0x07][a];
+#else
+    return ALUTables::Daa(a, nhc);
+#endif
+}
@@ -0,0 +1,197 @@
+#include "CPU.h"
+#include "Batch.h"
+
+#include <thread>
+#include <deque>
+#include <sstream>
+
+// one per worker, only ever locked for the moment it takes to pop a job index
+struct WorkQueue
+{
+    std::mutex lock;
+    std::deque<size_t> jobs;
+
+    bool TakeFront(size_t& job)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (jobs.empty()) {
+            return false;
+        }
+        job = jobs.front();
+        jobs.pop_front();
+        return true;
+    }
+
+    // thieves take from the other end so they don't fight the owner over the same jobs
+    bool StealBack(size_t& job)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (jobs.empty()) {
+            return false;
+        }
+        job = jobs.back();
+        jobs.pop_back();
+        return true;
+    }
+};
+
+static bool Steal(std::vector<std::unique_ptr<WorkQueue>>& queues, size_t self, size_t& job)
+{
+    // nothing gets queued once the workers have started, so once every queue is empty the batch is done
+    for (size_t i = 1; i < queues.size(); i++) {
+        if (queues[(self + i) % queues.size()]->StealBack(job)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char* RunToEnd(CPU& cpu, const BatchJob& job)
+{
+    uint64_t frames = 0;
+
+    while (cpu.running) {
+        const std::string& serial = cpu.serial.Output();
+        if (serial.find("Passed") != std::string::npos) {
+            return "passed";
+        }
+        if (serial.find("Failed") != std::string::npos) {
+            return "failed";
+        }
+
+        if ((job.frames && frames >= job.frames) || (job.cycles && cpu.cycles >= job.cycles)) {
+            return "budget";
+        }
+
+        // a frame at a time so the serial output gets looked at now and then, less if the cycle budget runs out first
+        uint64_t frameLeft = cpu.scheduler.When(EVENT_FRAME_END) - cpu.cycles;
+        uint32_t used;
+        if (job.cycles && job.cycles - cpu.cycles < frameLeft) {
+            used = cpu.Run(static_cast<uint32_t>(job.cycles - cpu.cycles));
+        }
+        else {
+            used = cpu.RunFrame();
+            frames++;
+        }
+
+        if (used == 0) {
+            break; // nothing can move anymore
+        }
+    }
+
+    return "stopped";
+}
+
+static BatchResult RunJob(const BatchJob& job)
+{
+    BatchResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    // every job on the same ROM gets the same image, only the CPU is new
+    std::shared_ptr<const RomImage> image = RomImage::Open(job.romPath.c_str());
+    if (image) {
+        CPU cpu;
+        if (cpu.LoadROM(std::move(image))) {
+            result.status = RunToEnd(cpu, job);
+            result.cycles = cpu.cycles;
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+bool ReadJobFile(const char* path, const BatchJob& defaults, std::vector<BatchJob>& jobs)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Error: Could not open job file " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+        std::istringstream words(line);
+
+        BatchJob job = defaults;
+        if (!(words >> job.romPath) || job.romPath[0] == '#') {
+            continue;
+        }
+
+        std::string option;
+        while (words >> option) {
+            uint64_t value;
+            if (!(words >> value)) {
+                std::cerr << "Error: " << path << ":" << number << ": " << option << " needs a number" << std::endl;
+                return false;
+            }
+
+            if (option == "--frames") {
+                job.frames = value;
+            }
+            else if (option == "--cycles") {
+                job.cycles = value;
+            }
+            else {
+                std::cerr << "Error: " << path << ":" << number << ": unknown option " << option << std::endl;
+                return false;
+            }
+        }
+
+        jobs.push_back(job);
+    }
+
+    return true;
+}
+
+std::vector<BatchResult> RunBatch(const std::vector<BatchJob>& jobs, unsigned threads, std::ostream& out)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, jobs.size())));
+
+    // dealt out round robin, the stealing evens out whatever that gets wrong
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    for (unsigned i = 0; i < threads; i++) {
+        queues.emplace_back(new WorkQueue());
+    }
+    for (size_t i = 0; i < jobs.size(); i++) {
+        queues[i % threads]->jobs.push_back(i);
+    }
+
+    std::vector<BatchResult> results(jobs.size());
+    std::mutex outLock;
+
+    out << "job\tstatus\tcycles\twall_ms\tMcycles/s\trom" << std::endl;
+
+    auto worker = [&](size_t self) {
+        size_t index;
+        while (queues[self]->TakeFront(index) || Steal(queues, self, index)) {
+            BatchResult result = RunJob(jobs[index]);
+            results[index] = result;
+
+            std::ostringstream line;
+            line << index << '\t' << result.status << '\t' << result.cycles << '\t'
+                << std::fixed << std::setprecision(1) << result.seconds * 1000 << '\t'
+                << (result.seconds > 0 ? result.cycles / result.seconds / 1e6 : 0.0) << '\t'
+                << jobs[index].romPath;
+
+            // written as soon as it's done so whatever is reading can get going on it
+            std::lock_guard<std::mutex> guard(outLock);
+            out << line.str() << std::endl;
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++) {
+        pool.emplace_back(worker, i);
+    }
+    worker(0);
+
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+
+    return results;
+}
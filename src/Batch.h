@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <iostream>
+
+/*
+
+Headless batch runner (GameboyEmulator --batch).
+
+Runs a list of jobs, each one a ROM with a frame and/or cycle budget, on every core at once. Every worker
+thread gets its own queue of jobs up front and takes from the front of it; once it runs dry it steals from the
+back of somebody else's. Jobs finish at very different times (a test that passes after a few frames next to one
+that runs its whole budget) so nobody ends up sitting idle while one thread works through a pile of long ones.
+
+A job ends as soon as the ROM prints "Passed" or "Failed" over serial (how the test ROMs report), the CPU stops
+running, or the budget runs out. Every job gets one tab separated line as it finishes:
+
+    job  status  cycles  wall_ms  Mcycles/s  rom
+
+status is one of passed, failed, stopped, budget or error (ROM couldn't be loaded). Instances of the same ROM
+share its image (Rom.h), everything else a job touches is its own.
+
+*/
+
+struct BatchJob
+{
+    std::string romPath;
+    uint64_t frames = 0; // 0 for no limit
+    uint64_t cycles = 0; // 0 for no limit
+};
+
+struct BatchResult
+{
+    const char* status = "error";
+    uint64_t cycles = 0;
+    double seconds = 0;
+};
+
+// lines are "rom [--frames n] [--cycles n]", the budget falls back on `defaults`. blank lines and # comments are skipped
+bool ReadJobFile(const char* path, const BatchJob& defaults, std::vector<BatchJob>& jobs);
+
+// 0 threads means one per core. the results come back in the same order as the jobs
+std::vector<BatchResult> RunBatch(const std::vector<BatchJob>& jobs, unsigned threads, std::ostream& out);
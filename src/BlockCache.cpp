@@ -0,0 +1,270 @@
+/*
+
+Pre-decoded block cache (GB_CORE_CACHED).
+
+A block is a run of instructions starting at some pc, decoded once into DecodedOps (handler, operand bytes,
+length and cycle cost) and stored under (bank, pc). Running a block skips the fetch, the table lookups and
+the operand reads, it just calls the handlers one after the other.
+
+Blocks end at anything that always changes the pc (JP/JR/CALL/RET/RST), HALT/STOP and EI/DI. Conditional
+branches don't end a block, if the branch is taken the pc won't be where the next op expects it and the
+block is left there. That check also covers any handler that moves the pc differently from the length table.
+
+codePages remembers which blocks were decoded from each page. While a page has any, its write pointer in the
+bus page table (Bus.cpp) is taken away, so writes to it go the slow way and throw away the blocks that overlap
+the written byte. The check is by address only so a write to the switchable bank area also drops blocks
+belonging to the banks that aren't mapped right now, that's fine. Switching banks doesn't drop anything,
+the blocks of the other banks just wait until they're mapped again.
+
+*/
+
+#include "CPU.h"
+
+// instruction length in bytes, 0xCB is counted as 2 since the CB opcodes don't have operands
+static const uint8_t opcodeLengths[256] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+};
+
+static const size_t MAX_BLOCK_OPS = 64;
+
+// blocks never leave the area they start in, so a bank switch can't swap out part of one
+static uint32_t AreaEnd(uint32_t addr)
+{
+    if (addr < 0x4000) return 0x4000; // ROM bank 0
+    if (addr < 0x8000) return 0x8000; // switchable ROM bank
+    if (addr < 0xA000) return 0xA000; // VRAM
+    if (addr < 0xC000) return 0xC000; // cartridge RAM
+    if (addr < 0xFF00) return 0xFF00; // WRAM, echo RAM and OAM
+    if (addr < 0xFF80) return addr;   // I/O registers, nothing to cache. LY and STAT aren't even up to date
+                                      // in memory until something reads them (Display.h), so it's always stepped
+    return 0x10000;                   // HRAM
+}
+
+static bool EndsBlock(uint8_t op)
+{
+    switch (op) {
+    case 0x10: case 0x76:                                  // STOP, HALT
+    case 0x18: case 0xC3: case 0xE9:                       // JR, JP, JP (HL)
+    case 0xCD: case 0xC9: case 0xD9:                       // CALL, RET, RETI
+    case 0xC7: case 0xCF: case 0xD7: case 0xDF:            // RST
+    case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+    case 0xC0: case 0xC8: case 0xD0: case 0xD8:            // RET cc, these usually get taken
+    case 0xF3: case 0xFB:                                  // DI, EI
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint32_t CPU::BlockKey(uint16_t addr) const
+{
+    uint32_t bank = 0;
+    if (addr < 0x4000) {
+        bank = cart.Bank0Number(); // MBC1 can switch this one too
+    }
+    else if (addr < 0x8000) {
+        bank = cart.BankXNumber();
+    }
+    return (bank << 16) | addr;
+}
+
+void CPU::FlushBlockCache()
+{
+    if (!blockCache.empty()) {
+        blockGeneration++;
+    }
+
+    blockCache.clear();
+    for (auto& page : codePages) {
+        page.clear();
+    }
+    MapMemory();
+
+    if (jitArena) {
+        jitArena->Reset();
+    }
+}
+
+CPU::DecodedBlock& CPU::FetchBlock(uint16_t addr)
+{
+    uint32_t key = BlockKey(addr);
+
+    auto it = blockCache.find(key);
+    if (it != blockCache.end()) {
+        blockStats.hits++;
+        return it->second;
+    }
+
+    blockStats.misses++;
+
+    DecodedBlock& block = blockCache[key];
+    DecodeBlock(addr, block);
+
+    for (uint32_t page = block.start >> 8; page <= (block.end - 1) >> 8; page++) {
+        codePages[page].push_back(key);
+        if (codePages[page].size() == 1) {
+            CodePageChanged(static_cast<uint8_t>(page));
+        }
+    }
+
+    return block;
+}
+
+void CPU::DecodeBlock(uint16_t addr, DecodedBlock& block)
+{
+    block.start = addr;
+    block.ops.clear();
+
+    uint32_t areaEnd = AreaEnd(addr);
+    uint32_t at = addr;
+    for (;;) {
+        DecodedOp op;
+        uint8_t code = ReadByte(static_cast<uint16_t>(at));
+
+        op.operand = OperandAt(static_cast<uint16_t>(at));
+        op.length = opcodeLengths[code];
+
+        if (code == 0xCB) {
+            op.opcode = ReadByte(static_cast<uint16_t>(at + 1));
+            op.handler = cbTable[op.opcode];
+            op.cycles = static_cast<uint8_t>(cbOpcodeCycles[op.opcode]);
+            op.prefixed = true;
+        }
+        else {
+            op.opcode = code;
+            op.handler = mainTable[code];
+            op.cycles = static_cast<uint8_t>(opcodeCycles[code]);
+            op.prefixed = false;
+        }
+
+        block.ops.push_back(op);
+        at += op.length;
+
+        // OperandAt always reads two bytes past the opcode so stay clear of the end of the area,
+        // RunBlocks doesn't start a block there either
+        if (EndsBlock(code) || block.ops.size() == MAX_BLOCK_OPS || at + 2 >= areaEnd) {
+            break;
+        }
+    }
+
+    // the last op's operand bytes count as part of the block even if it doesn't use them
+    uint32_t last = at - block.ops.back().length;
+    block.end = last + 3 < 0x10000 ? last + 3 : 0x10000;
+}
+
+void CPU::InvalidateCode(uint16_t addr)
+{
+    std::vector<uint32_t> keys = codePages[addr >> 8]; // copy, the loop removes entries from it
+
+    for (uint32_t key : keys) {
+        auto it = blockCache.find(key);
+        if (it != blockCache.end() && addr >= it->second.start && addr < it->second.end) {
+            DropBlock(it);
+        }
+    }
+}
+
+void CPU::InvalidatePages(uint8_t first, uint8_t last)
+{
+    for (uint32_t page = first; page <= last; page++) {
+        std::vector<uint32_t> keys = codePages[page];
+
+        for (uint32_t key : keys) {
+            auto it = blockCache.find(key);
+            if (it != blockCache.end()) {
+                DropBlock(it);
+            }
+        }
+    }
+}
+
+void CPU::DropBlock(std::unordered_map<uint32_t, DecodedBlock>::iterator it)
+{
+    const DecodedBlock& block = it->second;
+    uint32_t key = it->first;
+
+    for (uint32_t page = block.start >> 8; page <= (block.end - 1) >> 8; page++) {
+        std::vector<uint32_t>& list = codePages[page];
+        list.erase(std::remove(list.begin(), list.end(), key), list.end());
+        if (list.empty()) {
+            CodePageChanged(static_cast<uint8_t>(page));
+        }
+    }
+
+    blockCache.erase(it);
+    blockStats.invalidations++;
+    blockGeneration++;
+}
+
+void CPU::RunBlocks()
+{
+    while (!halted && !stopped && cycles < runDeadline) {
+        if (dmaActive || AreaEnd(pc) - pc < 3) {
+            // the instruction might run over into the next bank, just step it. same while OAM DMA has the bus,
+            // the fetches have to go through it and see 0xFF outside HRAM
+            Cycle();
+            continue;
+        }
+
+        DecodedBlock& block = FetchBlock(pc);
+
+#if GB_CORE == GB_CORE_JIT
+        if (!trace) { // the compiled code doesn't stop to record each instruction
+            if (!block.native && block.runs++ == GB_JIT_THRESHOLD && CanCompile(block)) {
+                CompileBlock(block);
+            }
+
+            if (block.native) {
+                block.native(this, static_cast<int32_t>(std::min<uint64_t>(runDeadline - cycles, INT32_MAX)));
+                continue;
+            }
+        }
+#endif
+
+        const DecodedOp* op = block.ops.data();
+        const DecodedOp* end = op + block.ops.size();
+        uint32_t generation = blockGeneration;
+
+        while (op != end) {
+            TRACE_INSTRUCTION();
+
+            // copied out first, the handler might write over this block and get it thrown away
+            DecodedOp current = *op++;
+            uint16_t next = pc + current.length;
+
+            opcode = current.opcode;
+            operand = current.operand;
+
+            if (current.prefixed) {
+                pc += 1;
+                (this->*current.handler)();
+                pc += 1;
+            }
+            else {
+                (this->*current.handler)();
+            }
+
+            cycles += current.cycles;
+
+            if (pc != next || halted || stopped || blockGeneration != generation
+                || cycles >= runDeadline) {
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,282 @@
+/*
+
+Memory bus.
+
+The address space is split into 256 pages of 256 bytes and each page has a read and a write pointer. Pages that
+are plain memory point straight at their bytes in `memory`, so a normal access is one table load, one null check
+and the access itself. Everything else is left null and goes through ReadUnmapped / WriteUnmapped:
+
+    0x0000 - 0x7FFF  cartridge ROM banks, reads are mapped, writes go to the bank controller (Cartridge.cpp)
+    0x8000 - 0x9FFF  VRAM, reads are mapped, writes go to the PPU so it knows which tiles changed (Display.cpp)
+    0xA000 - 0xBFFF  cartridge RAM bank, unmapped while it's disabled or the MBC3 clock is selected
+    0xC000 - 0xDFFF  WRAM
+    0xE000 - 0xFDFF  echo of 0xC000 - 0xDDFF, mapped onto the same bytes
+    0xFE00 - 0xFEFF  OAM, reads are mapped, writes go to the PPU like VRAM ones
+    0xFF00 - 0xFFFF  I/O registers, HRAM and IE, never mapped
+
+While OAM DMA runs nothing at all is mapped. The CPU can only reach I/O and HRAM then, everything else reads
+0xFF and ignores writes, and the first access after the transfer is done maps it all again.
+
+Pages that cached blocks were decoded from (BlockCache.cpp) get their write pointer taken away so writes to them
+end up in WriteUnmapped, which throws the blocks away. That keeps the check off the normal write path. Dirty page
+tracking for delta savestates (SaveState.cpp) works the same way, a page that hasn't been written since the base
+state has no write pointer until its first write.
+
+*/
+
+#include "CPU.h"
+
+// the other address a WRAM / echo RAM page shows up at, 0 if it doesn't have one
+static uint8_t EchoAlias(uint8_t page)
+{
+    if (page >= 0xC0 && page <= 0xDD) {
+        return page + 0x20;
+    }
+    if (page >= 0xE0 && page <= 0xFD) {
+        return page - 0x20;
+    }
+    return 0;
+}
+
+void CPU::MapMemory()
+{
+    for (int page = 0; page < 256; page++) {
+        MapPage(static_cast<uint8_t>(page));
+    }
+}
+
+void CPU::MapPage(uint8_t page)
+{
+    fetchLimit = 0;
+
+    if (page == 0xFF || dmaActive) {
+        readPages[page] = nullptr;
+        writePages[page] = nullptr;
+        return;
+    }
+
+    if (page < 0x80) {
+        const uint8_t* bank = page < 0x40 ? cart.Bank0() : cart.BankX();
+        if (page == 0x00 && biosMapped) {
+            readPages[page] = bios;
+        }
+        else {
+            readPages[page] = bank ? bank + ((page & 0x3F) << 8) : nullptr;
+        }
+        writePages[page] = nullptr;
+        return;
+    }
+
+    uint8_t* bytes;
+    if (page >= 0xA0 && page < 0xC0) {
+        uint8_t* ram = cart.Ram();
+        bytes = ram ? ram + ((page - 0xA0) << 8) : nullptr;
+    }
+    else {
+        bytes = &Mem(static_cast<uint16_t>((page >= 0xE0 && page <= 0xFD ? page - 0x20 : page) << 8));
+    }
+    readPages[page] = bytes;
+
+    uint8_t alias = EchoAlias(page);
+    bool hasCode = !codePages[page].empty() || (alias && !codePages[alias].empty());
+
+    int index = trackDirty ? DirtyIndex(page) : -1;
+    bool clean = index >= 0 && !IsDirty(index); // its first write has to be seen
+
+    bool video = page < 0xA0 || page == 0xFE; // VRAM and OAM, the PPU keeps things worked out from them
+
+    writePages[page] = hasCode || clean || video ? nullptr : bytes;
+}
+
+void CPU::MapCartridge()
+{
+#if GB_BLOCK_CACHE
+    // ROM blocks are keyed by bank, but cartridge RAM ones aren't, and what's behind 0xA000 might not
+    // even be RAM anymore. Code hardly ever runs from there so just drop them
+    InvalidatePages(0xA0, 0xBF);
+
+    blockGeneration++; // the block that's running might be from the bank that just went away
+#endif
+
+    // a bank switch only ever moves these, 96 pointers however big the cartridge is
+    for (int page = 0x00; page < 0x80; page++) {
+        MapPage(static_cast<uint8_t>(page));
+    }
+    for (int page = 0xA0; page < 0xC0; page++) {
+        MapPage(static_cast<uint8_t>(page));
+    }
+}
+
+void CPU::CodePageChanged(uint8_t page)
+{
+    MapPage(page);
+
+    uint8_t alias = EchoAlias(page);
+    if (alias) {
+        MapPage(alias);
+    }
+}
+
+void CPU::FetchSlow()
+{
+    opcode = ReadByte(pc);
+    operand = OperandAt(pc);
+
+    // only plain pages get kept, anything with a handler has to go through it every time
+    if (readPages[pc >> 8]) {
+        fetchPage = readPages[pc >> 8];
+        fetchStart = pc & 0xFF00;
+        fetchLimit = 0xFE;
+    }
+}
+
+uint8_t CPU::ReadUnmapped(uint16_t addr)
+{
+    if (dmaActive && addr < 0xFF00) {
+        if (cycles < scheduler.When(EVENT_DMA)) {
+            return 0xFF; // OAM DMA has the bus
+        }
+        EndDMA(); // it's over, the event just hasn't been dispatched yet
+        return ReadByte(addr);
+    }
+
+    if (addr < 0xFF00) {
+        if (addr >= 0xA000 && addr < 0xC000) {
+            return cart.ReadRam(addr);
+        }
+        return 0xFF; // no cartridge
+    }
+
+    if (addr < 0xFF80) {
+        return ReadIO(addr);
+    }
+
+    if (addr == 0xFFFF) {
+        return IE;
+    }
+
+    return Mem(addr); // HRAM
+}
+
+void CPU::WriteUnmapped(uint16_t addr, uint8_t value)
+{
+    if (dmaActive && addr < 0xFF00) {
+        if (cycles < scheduler.When(EVENT_DMA)) {
+            return;
+        }
+        EndDMA();
+        WriteByte(addr, value);
+        return;
+    }
+
+    if (addr < 0x8000) {
+        if (cart.Write(addr, value, cycles)) {
+            MapCartridge();
+        }
+        return;
+    }
+
+    if (trackDirty && MarkDirty(addr)) {
+        // first write since the base state, the page is mapped again now unless it still needs a handler
+        uint8_t* page = writePages[addr >> 8];
+        if (page) {
+            page[addr & 0xFF] = value;
+            return;
+        }
+    }
+
+    if (addr < 0xA000) {
+        display.WriteVram(addr, value);
+        return;
+    }
+
+    if (addr >= 0xA000 && addr < 0xC000) {
+        cart.WriteRam(addr, value, cycles);
+#if GB_BLOCK_CACHE
+        if (!codePages[addr >> 8].empty()) {
+            InvalidateCode(addr);
+        }
+#endif
+        return;
+    }
+
+    if (addr >= 0xFE00 && addr < 0xFF00) {
+        display.WriteOam(addr, value);
+        return;
+    }
+
+    if (addr >= 0xFF00) {
+        if (addr < 0xFF80) {
+            WriteIO(addr, value);
+        }
+        else if (addr == 0xFFFF) {
+            IE = value;
+            timer.InterruptEnableChanged(cycles);
+        }
+        else {
+            StoreByte(addr, value); // HRAM, code run from here is cached too
+        }
+        return;
+    }
+
+    // a RAM page with cached code on it
+    uint8_t alias = EchoAlias(addr >> 8);
+    if (!alias) {
+        StoreByte(addr, value);
+        return;
+    }
+
+    // WRAM, the code could have been decoded from either address
+    uint16_t other = static_cast<uint16_t>((alias << 8) | (addr & 0xFF));
+    StoreByte(std::min(addr, other), value);
+#if GB_BLOCK_CACHE
+    uint16_t echo = std::max(addr, other);
+    if (!codePages[echo >> 8].empty()) {
+        InvalidateCode(echo);
+    }
+#endif
+}
+
+int CPU::DirtyIndex(uint8_t page)
+{
+    if (page < 0x80 || page == 0xFF) {
+        return -1; // ROM, and I/O / HRAM which are always saved
+    }
+
+    if (page >= 0xA0 && page < 0xC0) {
+        if (!cart.Ram()) {
+            return -1; // writes there don't land anywhere
+        }
+        return 0x100 + cart.RamBankNumber() * 0x20 + (page - 0xA0);
+    }
+
+    return page >= 0xE0 && page <= 0xFD ? page - 0x20 : page; // echo RAM is WRAM's bytes
+}
+
+bool CPU::MarkDirty(uint16_t addr)
+{
+    uint8_t page = addr >> 8;
+    int index = DirtyIndex(page);
+    if (index < 0 || IsDirty(index)) {
+        return false;
+    }
+
+    dirtyPages[index >> 6] |= 1ull << (index & 63);
+
+    MapPage(page);
+    uint8_t alias = EchoAlias(page);
+    if (alias) {
+        MapPage(alias);
+    }
+
+    return true;
+}
+
+void CPU::ResetDirty(bool dirty)
+{
+    size_t pages = 0x100 + cart.RamSize() / 0x100;
+    dirtyPages.assign((pages + 63) / 64, dirty ? ~0ull : 0);
+    dirtyPages[0xFF >> 6] |= 1ull << (0xFF & 63);
+
+    MapMemory();
+}
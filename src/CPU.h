@@ -7,6 +7,12 @@
 #include <random>
 #include <fstream>
 #include <iomanip>
+#include <utility>
+#include <unordered_map>
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <mutex>
 #include <SDL.h>
 
 #define BIOS_START_ADDR 0x0000
@@ -14,6 +20,82 @@
 
 /*
 
+INTERPRETER CORES:
+
+    GB_CORE_TABLE    = member function pointer tables built at compile time
+    GB_CORE_SWITCH   = one big switch, the opcode bodies get inlined into it
+    GB_CORE_THREADED = computed goto with a dispatch at the end of every handler (GCC/Clang only)
+    GB_CORE_CACHED   = straight line blocks decoded once and kept in a cache keyed by (bank, pc), see BlockCache.cpp
+    GB_CORE_JIT      = GB_CORE_CACHED, but hot ROM blocks get compiled to x86-64 (Jit.cpp, x86-64 only)
+
+    pick one at build time, e.g. /D GB_CORE=GB_CORE_SWITCH, to A/B them
+
+*/
+
+#define GB_CORE_TABLE 0
+#define GB_CORE_SWITCH 1
+#define GB_CORE_THREADED 2
+#define GB_CORE_CACHED 3
+#define GB_CORE_JIT 4
+
+#ifndef GB_CORE
+#define GB_CORE GB_CORE_TABLE
+#endif
+
+#if GB_CORE == GB_CORE_THREADED && !defined(__GNUC__)
+#undef GB_CORE
+#define GB_CORE GB_CORE_SWITCH // MSVC has no computed goto
+#endif
+
+#if GB_CORE == GB_CORE_JIT && !(defined(_M_X64) || defined(__x86_64__))
+#undef GB_CORE
+#define GB_CORE GB_CORE_CACHED // the compiler only knows how to write x86-64
+#endif
+
+// the cached and JIT cores both run out of the block cache
+#define GB_BLOCK_CACHE (GB_CORE == GB_CORE_CACHED || GB_CORE == GB_CORE_JIT)
+
+// how many times a block has to run before the JIT compiles it, 0 compiles everything it can straight away.
+// compiling a block costs about as much as running it interpreted a few dozen times, and code that gets left
+// partway through leaves lots of blocks that start at slightly different places and only run that often, so
+// lower than this spends more on compiling than it gets back
+#ifndef GB_JIT_THRESHOLD
+#define GB_JIT_THRESHOLD 64
+#endif
+
+// Lazy flags: 8 bit arithmetic only records its operands and Z/N/H/C get worked out
+// the first time something reads F. Off by default since with GB_ALU_TABLES the eager path is a single
+// table load and that measured faster, build with /D GB_LAZY_FLAGS=1 to compare.
+#ifndef GB_LAZY_FLAGS
+#define GB_LAZY_FLAGS 0
+#endif
+
+// ALU tables: result and flags for 8 bit ADD/ADC/SUB/SBC/CP/INC/DEC/DAA come from compile time
+// lookup tables (ALUTables.h) instead of being worked out with branches every time.
+#ifndef GB_ALU_TABLES
+#define GB_ALU_TABLES 1
+#endif
+
+// Tracing: when compiled in, EnableTrace() starts recording every instruction into a binary ring
+// buffer (Trace.h). While it's not enabled the only cost is one null check per instruction,
+// build with /D GB_TRACE=0 to take even that out.
+#ifndef GB_TRACE
+#define GB_TRACE 1
+#endif
+
+#include "ALUTables.h"
+#include "SaveState.h"
+#include "Trace.h"
+#include "Jit.h"
+#include "Scheduler.h"
+#include "Display.h"
+#include "Timer.h"
+#include "Serial.h"
+#include "Joypad.h"
+#include "Cartridge.h"
+
+/*
+
 REGISTER INDEXES:
 
     0 = a
@@ -25,6 +107,9 @@ REGISTER INDEXES:
     6 = h
     7 = l
 
+    8 = (hl), only used as an operand by the templated handlers
+    9 = d8,   same as above
+
 */
 
 #define A 0
@@ -35,47 +120,164 @@ REGISTER INDEXES:
 #define F 5
 #define H 6
 #define L 7
+#define HL_IND 8
+#define IMM8 9
 
 class CPU
 {
 public:
     bool running = true;
+    uint16_t lastTestPC = 0; // check_test's infinite loop check
 
     uint8_t registers[8]{};
     uint16_t pc{};
     uint16_t sp{};
-    uint8_t* memory = new uint8_t[65536]{};
+    // 0x8000 - 0xFFFF, everything below that is the cartridge's (or the boot ROM's). Mem takes bus addresses
+    static const uint16_t MEMORY_START = 0x8000;
+    uint8_t* memory = new uint8_t[0x10000 - MEMORY_START]{};
+    uint8_t& Mem(uint16_t addr) { return memory[addr - MEMORY_START]; }
     uint16_t opcode;
     uint8_t addressingMode;
     uint8_t flags;
 
-    uint32_t cycles;
-
-    uint8_t* io_port = new uint8_t[0x100];
+    uint64_t cycles; // master timebase, everything gets scheduled against this
 
-    std::vector<uint8_t> romData;
+    Cartridge cart;
+    bool biosMapped = false; // boot ROM sits over 0x0000 - 0x00FF until 0xFF50 is written
+    uint8_t bios[0x100]{};
 
-    int numBanks;
-    int current_bank = 1;
+    const uint32_t CYCLES_PER_FRAME = Display::CYCLES_PER_FRAME;
+    uint64_t frameCount = 0; // EVENT_FRAME_END's that have gone by
 
-    const uint32_t CYCLES_PER_FRAME = 4194304 / 60;
+    Scheduler scheduler;
+    Display display;
+    Timer timer;
+    Serial serial;
+    Joypad joypad;
+    bool dmaActive = false; // OAM DMA in progress, the bus is locked out until EVENT_DMA
 
     CPU();
 
-    ~CPU() { delete[] memory; delete[] io_port; }
+    ~CPU() { delete[] memory; }
 
 public:
     bool LoadROM(const std::string& filename);
+    bool LoadROM(std::shared_ptr<const RomImage> image); // attach to an image that's already loaded, doesn't print anything
     void LoadBIOS(const char* path);
-    void switch_bank(int bank);
     void Cycle();
-    void Update();
+    uint32_t Run(uint32_t cycleBudget); // runs instructions until cycleBudget cycles have passed, returns cycles used
+    uint32_t RunFrame(); // runs up to the next EVENT_FRAME_END
     void check_test();
 
+    void SetSeed(uint64_t value) { seed = value; randGen.seed(static_cast<std::default_random_engine::result_type>(value)); }
+    uint64_t GetSeed() const { return seed; }
+
+    // savestates (SaveState.cpp). LoadState is false and nothing changes if the state is from another
+    // version or ROM. `out` keeps its capacity, saving into the same buffer again doesn't allocate
+    void SaveState(std::vector<uint8_t>& out) const;
+    bool LoadState(const uint8_t* data, size_t size);
+    bool LoadState(const std::vector<uint8_t>& state) { return LoadState(state.data(), state.size()); }
+
+    // incremental savestates. SaveBaseState is a full state that also starts tracking which 256 byte pages
+    // get written, a delta only has the pages written since then. LoadDeltaState only copies the pages that
+    // differ between what's there now and the delta, taken from the delta or from its base
+    void SaveBaseState(std::vector<uint8_t>& out);
+    bool SaveDeltaState(std::vector<uint8_t>& out) const; // false if there's no base to take it against
+    bool LoadDeltaState(const std::vector<uint8_t>& base, const std::vector<uint8_t>& delta);
+
+    void EnableTrace(size_t records); // keeps the last `records` instructions
+    void DisableTrace();
+
+    struct BlockCacheStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;        // blocks that had to be decoded
+        uint64_t invalidations = 0; // blocks thrown away because something wrote over their code
+        uint64_t compiled = 0;      // blocks the JIT turned into native code
+    };
+
+    const BlockCacheStats& GetBlockCacheStats() const { return blockStats; }
+    size_t CachedBlockCount() const { return blockCache.size(); }
+    void FlushBlockCache();
+
+    // every read and write the CPU does goes through the page tables (Bus.cpp). Plain RAM / ROM pages point
+    // straight at their bytes, anything that needs a handler (I/O, cartridge control, pages with cached code)
+    // is left null and goes to ReadUnmapped / WriteUnmapped
+    uint8_t ReadByte(uint16_t addr)
+    {
+        const uint8_t* page = readPages[addr >> 8];
+        if (page) {
+            return page[addr & 0xFF];
+        }
+        return ReadUnmapped(addr);
+    }
+
+    void WriteByte(uint16_t addr, uint8_t value)
+    {
+        uint8_t* page = writePages[addr >> 8];
+        if (page) {
+            page[addr & 0xFF] = value;
+            return;
+        }
+        WriteUnmapped(addr, value);
+    }
+
+    // a plain store with no I/O side effects, the hardware uses this to update its own registers.
+    // cached blocks still notice when their code changes
+    void StoreByte(uint16_t addr, uint8_t value)
+    {
+        Mem(addr) = value;
+#if GB_BLOCK_CACHE
+        if (!codePages[addr >> 8].empty()) {
+            InvalidateCode(addr);
+        }
+#endif
+    }
+
+    std::unique_ptr<TraceBuffer> trace; // null while tracing is off
+
+private:
+    const uint8_t* readPages[256]; // 256 byte pages, null means the access needs a handler
+    uint8_t* writePages[256];
+
+    // the page instructions are being fetched from, so the fetch doesn't wait on a page table load every time.
+    // MapPage drops it whenever the tables change
+    const uint8_t* fetchPage = nullptr;
+    uint16_t fetchStart = 0;
+    uint16_t fetchLimit = 0; // how far past fetchStart an opcode can be with both operand bytes still on the page
+
+    void MapMemory(); // builds both page tables from scratch
+    void MapPage(uint8_t page);
+    void MapCartridge(); // after a bank switch
+    void CodePageChanged(uint8_t page); // a page gained its first cached block or lost its last one
+    uint8_t ReadUnmapped(uint16_t addr);
+    void WriteUnmapped(uint16_t addr, uint8_t value);
+
+    // dirty pages since the base state. While tracking, pages that haven't been written yet have no write
+    // pointer, the first write ends up in WriteUnmapped which marks the page and maps it back, so the normal
+    // write path doesn't pay for any of it. Bits 0x80 - 0xFF are address pages (page 0xFF is always
+    // dirty, it's I/O and HRAM and written all the time), 0x100 + n is page n of cartridge RAM
+    bool trackDirty = false;
+    std::vector<uint64_t> dirtyPages;
+    std::vector<uint64_t> deltaPages; // LoadDeltaState's scratch, kept so loading doesn't allocate
+    uint32_t baseSerial = 0; // which base state the pages are dirty against
+    uint64_t baseCycles = 0;
+
+    int DirtyIndex(uint8_t page); // -1 if writes to the page aren't tracked
+    bool IsDirty(int index) const { return (dirtyPages[index >> 6] >> (index & 63)) & 1; }
+    bool MarkDirty(uint16_t addr); // true the first time a page gets written
+    void ResetDirty(bool dirty); // every page clean or every page dirty
+    uint8_t* PageBytes(int index) { return index < 0x100 ? &Mem(static_cast<uint16_t>(index << 8)) : cart.RamBytes() + ((index - 0x100) << 8); }
+    const uint8_t* PageBytes(int index) const { return const_cast<CPU*>(this)->PageBytes(index); }
+
+    void SaveCore(StateWriter& state) const; // everything but RAM
+    bool LoadCore(StateReader& state);
+
 public:
-    static uint8_t IE; // Interrupt Enable Register
-    static uint8_t IF; // Interrupt Flag Register
-    static bool IME;
+    // per instance like everything else, two CPUs never share anything they write to
+    uint8_t IE = 0; // Interrupt Enable Register
+    uint8_t IF = 0; // Interrupt Flag Register
+    bool IME = false;
 
     const uint16_t INTERRUPT_VECTORS[5] = { 0x40, 0x48, 0x50, 0x58, 0x60 };
 
@@ -87,16 +289,19 @@ public:
 
 private:
     typedef void (CPU::* CPUFunc)();
-    typedef uint16_t(CPU::* CPUAddrModeFuncWithParam)(uint8_t);
-    typedef uint16_t(CPU::* CPUAddrModeFunc)(); // No parameters
 
     bool stopped = false;
     bool halted = false;
 
-    CPUFunc* mainTable = new CPUFunc[256];
-    CPUFunc* cbTable = new CPUFunc[256];
-    CPUAddrModeFuncWithParam addressModeTableWithParam[4];
-    CPUAddrModeFunc addressModeTable[4];
+    struct OpcodeTable
+    {
+        CPUFunc op[256];
+        constexpr CPUFunc operator[](int i) const { return op[i]; }
+    };
+
+    // both tables are built at compile time, see the bottom of opcodes.cpp
+    static const OpcodeTable mainTable;
+    static const OpcodeTable cbTable;
 
     const int opcodeCycles[256] = {
     4, 8, 8, 8, 4, 4, 8, 4, 20, 8, 8, 8, 4, 4, 8, 4,
@@ -117,10 +322,90 @@ private:
     12, 12, 12, 12, 12, 12, 8, 12, 12, 12, 12, 12, 12, 12, 8, 12,
     };
 
+    const int cbOpcodeCycles[256] = {
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    8, 8, 8, 8, 8, 8, 12, 8, 8, 8, 8, 8, 8, 8, 12, 8,
+    8, 8, 8, 8, 8, 8, 12, 8, 8, 8, 8, 8, 8, 8, 12, 8,
+    8, 8, 8, 8, 8, 8, 12, 8, 8, 8, 8, 8, 8, 8, 12, 8,
+    8, 8, 8, 8, 8, 8, 12, 8, 8, 8, 8, 8, 8, 8, 12, 8,
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    8, 8, 8, 8, 8, 8, 16, 8, 8, 8, 8, 8, 8, 8, 16, 8,
+    };
+
+    // seeded from `seed` and not the clock, so two runs of the same thing with the same inputs come out the same
+    uint64_t seed = 0;
     std::default_random_engine randGen;
     std::uniform_int_distribution<unsigned int> randByte;
 
-    void InitTables();
+    template<uint8_t op>
+    static constexpr CPUFunc GeneratedHandler();
+    template<size_t... ops>
+    static constexpr OpcodeTable MakeMainTable(std::index_sequence<ops...>);
+    template<size_t... ops>
+    static constexpr OpcodeTable MakeCBTable(std::index_sequence<ops...>);
+
+    void ExecuteMain(uint8_t op); // switch core, defined in opcodes.cpp so the handlers inline
+    void ExecuteCB(uint8_t op);
+    void RunThreaded(); // computed goto core, also in opcodes.cpp
+
+    bool RunUntil(uint64_t deadline); // runs whichever core was built in, false if nothing could run (halted / stopped)
+    uint64_t runDeadline = 0; // where the slice RunUntil is in stops, EndRunBy can pull it in
+    void DispatchEvents(); // runs every event that's due
+    void WriteIO(uint16_t addr, uint8_t value);
+    uint8_t ReadIO(uint16_t addr);
+    void StartDMA(uint8_t page);
+    void EndDMA(); // gives the bus back
+    void ResetHardware();
+
+    // one instruction of a cached block, everything Cycle() would have worked out from memory
+    struct DecodedOp
+    {
+        CPUFunc handler;
+        uint16_t operand;
+        uint8_t opcode; // the second byte for CB opcodes
+        uint8_t length;
+        uint8_t cycles;
+        bool prefixed;  // CB opcode
+    };
+
+    typedef void (*JitBlock)(CPU* cpu, int32_t budget); // budget is how many cycles are left before the deadline
+
+    struct DecodedBlock
+    {
+        uint16_t start;
+        uint32_t end; // one past the last byte the block was decoded from
+        std::vector<DecodedOp> ops;
+        uint32_t runs = 0;
+        JitBlock native = nullptr; // set once the JIT has compiled it
+    };
+
+    std::unordered_map<uint32_t, DecodedBlock> blockCache; // key is bank << 16 | start address
+    std::vector<uint32_t> codePages[256]; // keys of the blocks decoded from each 256 byte page
+    uint32_t blockGeneration = 0; // goes up every time a block is thrown away
+    BlockCacheStats blockStats;
+
+    uint32_t BlockKey(uint16_t addr) const;
+    DecodedBlock& FetchBlock(uint16_t addr);
+    void DecodeBlock(uint16_t addr, DecodedBlock& block);
+    void InvalidateCode(uint16_t addr);
+    void InvalidatePages(uint8_t first, uint8_t last); // every block with code on these pages
+    void DropBlock(std::unordered_map<uint32_t, DecodedBlock>::iterator it);
+    void RunBlocks(); // block cache core, BlockCache.cpp
+
+    std::unique_ptr<JitArena> jitArena; // only mapped once the first block gets compiled
+
+    bool CanCompile(const DecodedBlock& block) const;
+    void CompileBlock(DecodedBlock& block); // Jit.cpp
+    void ResetJit(); // forgets every compiled block
 
 private:
     // Main opcodes
@@ -128,201 +413,49 @@ private:
     void OP_01(); // LD BC,nn
     void OP_02(); // LD (BC),A
     void OP_03(); // INC BC
-    void OP_04(); // INC B
-    void OP_05(); // DEC B
-    void OP_06(); // LD B,n
     void OP_07(); // RLCA
     void OP_08(); // LD (nn),SP
     void OP_09(); // ADD HL,BC
     void OP_0A(); // LD A,(BC)
     void OP_0B(); // DEC BC
-    void OP_0C(); // INC C
-    void OP_0D(); // DEC C
-    void OP_0E(); // LD C,n
     void OP_0F(); // RRCA
     void OP_10(); // STOP 0
     void OP_11(); // LD DE, d16
     void OP_12(); // LD (DE), A
     void OP_13(); // INC DE
-    void OP_14(); // INC D
-    void OP_15(); // DEC D
-    void OP_16(); // LD D, d8
     void OP_17(); // RLA
     void OP_18(); // JR r8 
     void OP_19(); // ADD HL, DE
     void OP_1A(); // LD A, (DE)
     void OP_1B(); // DEC DE
-    void OP_1C(); // INC E
-    void OP_1D(); // DEC E
-    void OP_1E(); // LD E, d8 
     void OP_1F(); // RRA
     void OP_20(); // JR NZ, r8
     void OP_21(); // LD HL, d16
     void OP_22(); // LD (HL+), A
     void OP_23(); // INC HL
-    void OP_24(); // INC H
-    void OP_25(); // DEC H
-    void OP_26(); // LD H, d8
     void OP_27(); // DAA
     void OP_28(); // JR Z, r8
     void OP_29(); // ADD HL, HL
     void OP_2A(); // LD A, (HL+)
     void OP_2B(); // DEC HL
-    void OP_2C(); // INC L
-    void OP_2D(); // DEC L
-    void OP_2E(); // LD L, d8
     void OP_2F(); // CPL
     void OP_30(); // JR NC, r8
     void OP_31(); // LD SP, d16
     void OP_32(); // LD (HL-), A
     void OP_33(); // INC SP
-    void OP_34(); // INC (HL)
-    void OP_35(); // DEC (DEC)
-    void OP_36(); // LD HL, d8
     void OP_37(); // SCF
     void OP_38(); // JR C, r8
     void OP_39(); // ADD HL, SP
     void OP_3A(); // LD A, (HL-)
     void OP_3B(); // DEC SP
-    void OP_3C(); // INC A 
-    void OP_3D(); // DEC A
-    void OP_3E(); // LD A, d8
     void OP_3F(); // CCF
-    void OP_40(); // LD B, B
-    void OP_41(); // LD B, C
-    void OP_42(); // LD B, D
-    void OP_43(); // LD B, E
-    void OP_44(); // LD B, H
-    void OP_45(); // LD B, L
-    void OP_46(); // LD B, (HL)
-    void OP_47(); // LD B, A
-    void OP_48(); // LD C, B
-    void OP_49(); // LD C, C
-    void OP_4A(); // LD C, D
-    void OP_4B(); // LD C, E
-    void OP_4C(); // LD C, H
-    void OP_4D(); // LD C, L
-    void OP_4E(); // LD C, (HL)
-    void OP_4F(); // LD C, A
-    void OP_50(); // LD D, B
-    void OP_51(); // LD D, C
-    void OP_52(); // LD D, D
-    void OP_53(); // LD D, E
-    void OP_54(); // LD D, H
-    void OP_55(); // LD D, L
-    void OP_56(); // LD D, (HL)
-    void OP_57(); // LD D, A
-    void OP_58(); // LD E, B
-    void OP_59(); // LD E, C
-    void OP_5A(); // LD E, D
-    void OP_5B(); // LD E, E
-    void OP_5C(); // LD E, H
-    void OP_5D(); // LD E, L
-    void OP_5E(); // LD E, (HL)
-    void OP_5F(); // LD E, A
-    void OP_60(); // LD H, B
-    void OP_61(); // LD H, C
-    void OP_62(); // LD H, D
-    void OP_63(); // LD H, E
-    void OP_64(); // LD H, H
-    void OP_65(); // LD H, L
-    void OP_66(); // LD H, (HL)
-    void OP_67(); // LD H, A
-    void OP_68(); // LD L, B
-    void OP_69(); // LD L, C
-    void OP_6A(); // LD L, D
-    void OP_6B(); // LD L, E
-    void OP_6C(); // LD L, H
-    void OP_6D(); // LD L, L
-    void OP_6E(); // LD L, (HL)
-    void OP_6F(); // LD L, A
-    void OP_70(); // LD (HL), B
-    void OP_71(); // LD (HL), C
-    void OP_72(); // LD (HL), D
-    void OP_73(); // LD (HL), E
-    void OP_74(); // LD (HL), H
-    void OP_75(); // LD (HL), L
     void OP_76(); // HALT
-    void OP_77(); // LD (HL), A
-    void OP_78(); // LD A, B
-    void OP_79(); // LD A, C
-    void OP_7A(); // LD A, D
-    void OP_7B(); // LD A, E
-    void OP_7C(); // LD A, H
-    void OP_7D(); // LD A, L
-    void OP_7E(); // LD A, (HL)
-    void OP_7F(); // LD A, A
-    void OP_80(); // ADD A, B
-    void OP_81(); // ADD A, C
-    void OP_82(); // ADD A, D
-    void OP_83(); // ADD A, E
-    void OP_84(); // ADD A, H
-    void OP_85(); // ADD A, L
-    void OP_86(); // ADD A, (HL)
-    void OP_87(); // ADD A, A
-    void OP_88(); // ADC A, B
-    void OP_89(); // ADC A, C
-    void OP_8A(); // ADC A, D
-    void OP_8B(); // ADC A, E
-    void OP_8C(); // ADC A, H
-    void OP_8D(); // ADC A, L
-    void OP_8E(); // ADC A, (HL)
-    void OP_8F(); // ADC A, A
-    void OP_90(); // SUB B
-    void OP_91(); // SUB C
-    void OP_92(); // SUB D
-    void OP_93(); // SUB E
-    void OP_94(); // SUB H
-    void OP_95(); // SUB L
-    void OP_96(); // SUB (HL)
-    void OP_97(); // SUB A
-    void OP_98(); // SBC A, B
-    void OP_99(); // SBC A, C
-    void OP_9A(); // SBC A, D
-    void OP_9B(); // SBC A, E
-    void OP_9C(); // SBC A, H
-    void OP_9D(); // SBC A, L
-    void OP_9E(); // SBC A, (HL)
-    void OP_9F(); // SBC A, A
-    void OP_A0(); // AND B
-    void OP_A1(); // AND C
-    void OP_A2(); // AND D
-    void OP_A3(); // AND E
-    void OP_A4(); // AND H
-    void OP_A5(); // AND L
-    void OP_A6(); // AND (HL)
-    void OP_A7(); // AND A
-    void OP_A8(); // XOR B
-    void OP_A9(); // XOR C
-    void OP_AA(); // XOR D
-    void OP_AB(); // XOR E
-    void OP_AC(); // XOR H
-    void OP_AD(); // XOR L
-    void OP_AE(); // XOR (HL)
-    void OP_AF(); // XOR A
-    void OP_B0(); // OR B
-    void OP_B1(); // OR C
-    void OP_B2(); // OR D
-    void OP_B3(); // OR E
-    void OP_B4(); // OR H
-    void OP_B5(); // OR L
-    void OP_B6(); // OR (HL)
-    void OP_B7(); // OR A
-    void OP_B8(); // CP B
-    void OP_B9(); // CP C
-    void OP_BA(); // CP D
-    void OP_BB(); // CP E
-    void OP_BC(); // CP H
-    void OP_BD(); // CP L
-    void OP_BE(); // CP (HL)
-    void OP_BF(); // CP A
     void OP_C0(); // RET NZ
     void OP_C1(); // POP BC
     void OP_C2(); // JP NZ, a16
     void OP_C3(); // JP a16
     void OP_C4(); // CALL NZ, a16
     void OP_C5(); // PUSH BC
-    void OP_C6(); // ADD A, d8
     void OP_C7(); // RST 00H
     void OP_C8(); // RET Z
     void OP_C9(); // RET
@@ -330,7 +463,6 @@ private:
   //void OP_CB(); // PREFIX CB not needed
     void OP_CC(); // CALL Z, a16
     void OP_CD(); // CALL a16
-    void OP_CE(); // ADC A, d8
     void OP_CF(); // RST 08H
     void OP_D0(); // RET NC
     void OP_D1(); // POP DE
@@ -338,7 +470,6 @@ private:
     void OP_D3(); // OUT (C), A
     void OP_D4(); // CALL NC, a16
     void OP_D5(); // PUSH DE
-    void OP_D6(); // SUB d8
     void OP_D7(); // RST 10H
     void OP_D8(); // RET C
     void OP_D9(); // RETI
@@ -346,7 +477,6 @@ private:
     void OP_DB(); // IN A, (C)
     void OP_DC(); // CALL C, a16
     void OP_DD(); // NOP
-    void OP_DE(); // SBC A, d8
     void OP_DF(); // RST 18H
     void OP_E0(); // LD (a8), A
     void OP_E1(); // POP HL
@@ -354,7 +484,6 @@ private:
     void OP_E3(); // NOP
     void OP_E4(); // NOP
     void OP_E5(); // PUSH HL
-    void OP_E6(); // AND d8
     void OP_E7(); // RST 20H
     void OP_E8(); // ADD SP, r8
     void OP_E9(); // JP (HL)
@@ -362,15 +491,13 @@ private:
     void OP_EB(); // NOP
     void OP_EC(); // NOP
     void OP_ED(); // NOP
-    void OP_EE(); // XOR d8
     void OP_EF(); // RST 28H
-    void OP_F0(); // LD A, (a16)
+    void OP_F0(); // LD A, (a8)
     void OP_F1(); // POP AF
     void OP_F2(); // LD A, (C)
     void OP_F3(); // DI
     void OP_F4(); // NOP
     void OP_F5(); // PUSH AF
-    void OP_F6(); // OR d8
     void OP_F7(); // RST 30H
     void OP_F8(); // LD HL, SP+r8
     void OP_F9(); // LD SP, HL
@@ -378,46 +505,73 @@ private:
     void OP_FB(); // EI
     void OP_FC(); // NOP
     void OP_FD(); // NOP
-    void OP_FE(); // CP d8
     void OP_FF(); // RST 38H
 
-    // CB-prefixed opcodes
-    void CB_00(); // RLC B
-    void CB_01(); // RLC C
-    void CB_02(); // RLC D
-    void CB_03(); // RLC E
-    void CB_04(); // RLC H
-    void CB_05(); // RLC L
-    void CB_06(); // RLC (HL)
-    void CB_07(); // RLC A
-    void CB_08(); // RRC B
-    void CB_09(); // RRC C
-    void CB_0A(); // RRC D
-    void CB_0B(); // RRC E
-    void CB_0C(); // RRC H
-    void CB_0D(); // RRC L
-    void CB_0E(); // RRC (HL)
-    void CB_0F(); // RRC A
-
     void OP_NULL(); // Handler for unimplemented opcodes
 
+    // The regular blocks are generated from these templates instead of being written out by hand.
+    // Register arguments use the indexes at the top of this file (HL_IND / IMM8 for (HL) and d8).
+    // LD r, r' / LD r, d8 / LD (HL), r          0x40 - 0x7F, 0x06 - 0x3E
+    // ADD ADC SUB SBC AND XOR OR CP              0x80 - 0xBF, 0xC6 - 0xFE
+    // INC r / DEC r                              0x04 - 0x3D
+    // every CB opcode (op is the top 2 bits of the opcode, bit is the middle 3 which pick the shift kind for op 0)
+    enum AluOp : uint8_t { ALU_ADD, ALU_ADC, ALU_SUB, ALU_SBC, ALU_AND, ALU_XOR, ALU_OR, ALU_CP };
+    enum CBOp : uint8_t { CB_SHIFT, CB_BIT, CB_RES, CB_SET };
+    enum ShiftOp : uint8_t { SH_RLC, SH_RRC, SH_RL, SH_RR, SH_SLA, SH_SRA, SH_SWAP, SH_SRL };
+
+    template<uint8_t dst, uint8_t src> void LD();
+    template<uint8_t op, uint8_t r> void ALU();
+    template<uint8_t r> void INC();
+    template<uint8_t r> void DEC();
+    template<uint8_t op, uint8_t bit, uint8_t r> void CB();
+
+    template<uint8_t r> uint8_t ReadR8();
+    template<uint8_t r> void WriteR8(uint8_t value);
+
+    // opcode bits 0-2 / 3-5 to register index
+    static constexpr uint8_t RegFromCode(uint8_t code)
+    {
+        return code == 6 ? HL_IND : code == 7 ? A : code < 4 ? code + 1 : code + 2;
+    }
+
 private:
-    // Addressing modes
-    uint16_t AddrMode_Immediate();
-    uint16_t AddrMode_Immediate16();
-    uint16_t AddrMode_Direct();
-    uint16_t AddrMode_Register(uint8_t reg);
-    uint16_t AddrMode_Indirect(uint8_t addr);
+    // The bytes after the opcode, read once when the instruction is fetched (or when its block is decoded).
+    // Handlers take their immediates from here instead of going back to memory.
+    uint16_t operand = 0;
+
+    uint16_t OperandAt(uint16_t addr)
+    {
+        return ReadByte(addr + 1) | (ReadByte(addr + 2) << 8);
+    }
+
+    // opcode and operand at pc
+    void FetchInstruction()
+    {
+        uint16_t offset = pc - fetchStart;
+        if (offset < fetchLimit) {
+            opcode = fetchPage[offset];
+            operand = fetchPage[offset + 1] | (fetchPage[offset + 2] << 8);
+            return;
+        }
+        FetchSlow();
+    }
+
+    void FetchSlow();
+
+    uint8_t Imm8() const { return operand & 0xFF; }
+    uint16_t Imm16() const { return operand; }
 
     void SetFlag(uint8_t flag, bool value);
-    bool GetFlag(uint8_t flag) const;
+    void SetFlags(uint8_t value); // writes all four flags at once
+    bool GetFlag(uint8_t flag);
+    uint8_t CarryFlag(); // 1 or 0, doesn't need the other flags to be worked out
     void UpdateFlags(); // update the 'flags variable'
+    void ResolveFlags(); // works out F if the last ALU op left it pending
     void UpdateFlagsAfterArithmetic(uint32_t result, uint16_t operand1, uint16_t operand2, bool isSubtraction);
-    void UpdateFlagsAfterIncrement(int reg_index, int result);
-    void UpdateFlagsAfterDecrement(int reg_index, int result);
-    void UFAI16(uint16_t reg, int result); // update flags after increment but with 16 bit registers
-    void UFAD16(uint16_t reg, int result); // same as above but with decremement flags
-    void UFARA(uint16_t result, uint8_t op1, uint8_t op2, bool is_subtraction); // update flags after register arithmetic
+    uint8_t Add8(uint8_t a, uint8_t b, uint8_t carry); // a + b + carry, sets the flags
+    uint8_t Sub8(uint8_t a, uint8_t b, uint8_t carry); // a - b - carry, sets the flags
+    uint8_t Inc8(uint8_t value);
+    uint8_t Dec8(uint8_t value);
     void UFAAO(uint8_t result); // update flags after and operation
     void UFAOXO(uint8_t result); // update flags after or / xor operation
 
@@ -427,6 +581,7 @@ private:
     void CheckInterrupts();
     void HandleInterrupt();
     void ExecuteInterruptRoutine(int interruptIndex);
+    bool CanWake() const; // whether a pending interrupt would get the cpu out of HALT / STOP
     //void UpdateInterrupts();
 
     void VBlankInterrupt();
@@ -440,7 +595,16 @@ private:
     static const uint8_t FLAG_H = 0x20; // Half carry flag
     static const uint8_t FLAG_C = 0x10; // Carry flag
 
-    uint16_t GetAF() const;
+    // what the last flag setting op was, F is only up to date when this is LAZY_NONE
+    enum LazyFlagOp : uint8_t { LAZY_NONE, LAZY_ADD, LAZY_SUB, LAZY_INC, LAZY_DEC };
+
+    uint8_t lazyOp = LAZY_NONE;
+    uint8_t lazyOp1 = 0;
+    uint8_t lazyOp2 = 0;
+    uint8_t lazyCarry = 0; // carry in for ADD/SUB, the untouched carry for INC/DEC
+    uint16_t lazyResult = 0; // only kept for ADD, carry out of bit 7
+
+    uint16_t GetAF();
     void SetAF(uint16_t value);
 
     uint16_t GetBC() const;
@@ -454,8 +618,15 @@ private:
 
 public:
     uint8_t val;
-    static void RequestInterrupt(int index);
+    void RequestInterrupt(int index) { IF |= (1 << index); } // peripherals raise theirs on the CPU they belong to
+    void EndRunBy(uint64_t when); // something got scheduled for before the running slice ends, it has to stop there
 
 private:
-    void register_out(); // displays the values of all the registers
+    void TraceInstruction(); // records the instruction at pc before it runs
 };
+
+#if GB_TRACE
+#define TRACE_INSTRUCTION() if (trace) TraceInstruction()
+#else
+#define TRACE_INSTRUCTION()
+#endif
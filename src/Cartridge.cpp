@@ -0,0 +1,272 @@
+#include "CPU.h"
+
+bool Cartridge::Load(std::shared_ptr<const RomImage> image)
+{
+    // images are always at least two banks so the header is there
+    uint8_t typeCode = image->Data()[0x147];
+    uint8_t ramCode = image->Data()[0x149];
+
+    switch (typeCode) {
+    case 0x00: case 0x08: case 0x09:
+        type = MBC_NONE; hasClock = false; break;
+    case 0x01: case 0x02: case 0x03:
+        type = MBC_1; hasClock = false; break;
+    case 0x0F: case 0x10:
+        type = MBC_3; hasClock = true; break;
+    case 0x11: case 0x12: case 0x13:
+        type = MBC_3; hasClock = false; break;
+    case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E:
+        type = MBC_5; hasClock = false; break;
+    default:
+        std::cerr << "Error: Unsupported cartridge type " << std::hex << +typeCode << std::endl;
+        return false;
+    }
+
+    romBanks = static_cast<uint32_t>(image->Size() / ROM_BANK_SIZE);
+    rom = std::move(image);
+
+    static const uint32_t ramSizes[6] = { 0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000 };
+    uint32_t ramSize = ramCode < 6 ? ramSizes[ramCode] : 0;
+    ramBanks = (ramSize + RAM_BANK_SIZE - 1) / RAM_BANK_SIZE; // 2KB carts still get a whole bank
+    ram.assign(ramBanks * RAM_BANK_SIZE, 0);
+
+    ramEnabled = false;
+    bankLow = 1;
+    bankHigh = 0;
+    bankingMode = false;
+    clockBase = 0;
+    clockStart = 0;
+    clockHalted = false;
+    clockCarry = false;
+    latchWrite = 0xFF;
+    Remap();
+
+    return true;
+}
+
+const char* Cartridge::TypeName() const
+{
+    switch (type) {
+    case MBC_1: return "MBC1";
+    case MBC_3: return hasClock ? "MBC3 + clock" : "MBC3";
+    case MBC_5: return "MBC5";
+    default: return "ROM only";
+    }
+}
+
+uint32_t Cartridge::HeaderHash() const
+{
+    uint32_t hash = 2166136261u;
+    if (Loaded()) {
+        const uint8_t* header = rom->Data();
+        for (uint16_t addr = 0x134; addr < 0x150; addr++) {
+            hash = (hash ^ header[addr]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+bool Cartridge::RamMapped() const
+{
+    if (ram.empty()) {
+        return false;
+    }
+
+    if (type == MBC_NONE) {
+        return true;
+    }
+
+    return ramEnabled && !(type == MBC_3 && bankHigh >= 0x08);
+}
+
+bool Cartridge::Write(uint16_t addr, uint8_t value, uint64_t now)
+{
+    uint32_t oldBank0 = bank0;
+    uint32_t oldBankX = bankX;
+    uint32_t oldRamBank = ramBank;
+    bool oldRamMapped = RamMapped();
+
+    switch (type) {
+    case MBC_1:
+        if (addr < 0x2000) {
+            ramEnabled = (value & 0x0F) == 0x0A;
+        }
+        else if (addr < 0x4000) {
+            bankLow = value & 0x1F;
+            bankLow = bankLow ? bankLow : 1; // bank 0 can't be picked here, the zero check is on these 5 bits only
+        }
+        else if (addr < 0x6000) {
+            bankHigh = value & 0x03;
+        }
+        else {
+            bankingMode = value & 0x01;
+        }
+        break;
+
+    case MBC_3:
+        if (addr < 0x2000) {
+            ramEnabled = (value & 0x0F) == 0x0A;
+        }
+        else if (addr < 0x4000) {
+            bankLow = value & 0x7F;
+            bankLow = bankLow ? bankLow : 1;
+        }
+        else if (addr < 0x6000) {
+            bankHigh = value;
+        }
+        else {
+            // writing 0 then 1 copies the clock into the registers that can be read
+            if (latchWrite == 0x00 && value == 0x01 && hasClock) {
+                LatchClock(now);
+            }
+            latchWrite = value;
+        }
+        break;
+
+    case MBC_5:
+        if (addr < 0x2000) {
+            ramEnabled = (value & 0x0F) == 0x0A;
+        }
+        else if (addr < 0x3000) {
+            bankLow = (bankLow & 0x100) | value;
+        }
+        else if (addr < 0x4000) {
+            bankLow = (bankLow & 0xFF) | ((value & 0x01) << 8);
+        }
+        else if (addr < 0x6000) {
+            bankHigh = value & 0x0F;
+        }
+        break;
+
+    default:
+        return false; // nothing to write to
+    }
+
+    Remap();
+
+    return bank0 != oldBank0 || bankX != oldBankX || ramBank != oldRamBank || RamMapped() != oldRamMapped;
+}
+
+void Cartridge::Remap()
+{
+    switch (type) {
+    case MBC_1:
+        bankX = ((bankHigh << 5) | bankLow) % romBanks;
+        bank0 = bankingMode ? (bankHigh << 5) % romBanks : 0; // mode 1 moves the top bits onto 0x0000 too
+        ramBank = bankingMode && ramBanks ? bankHigh % ramBanks : 0;
+        break;
+    case MBC_3:
+        bankX = bankLow % romBanks;
+        bank0 = 0;
+        ramBank = bankHigh < 0x08 && ramBanks ? bankHigh % ramBanks : 0;
+        break;
+    case MBC_5:
+        bankX = bankLow % romBanks;
+        bank0 = 0;
+        ramBank = ramBanks ? bankHigh % ramBanks : 0;
+        break;
+    default:
+        bankX = 1;
+        bank0 = 0;
+        ramBank = 0;
+        break;
+    }
+}
+
+uint8_t Cartridge::ReadRam(uint16_t addr)
+{
+    if (RamMapped()) {
+        return Ram()[addr & (RAM_BANK_SIZE - 1)];
+    }
+
+    if (type == MBC_3 && hasClock && ramEnabled && bankHigh >= 0x08 && bankHigh <= 0x0C) {
+        return clockLatched[bankHigh - 0x08];
+    }
+
+    return 0xFF; // nothing drives the bus
+}
+
+void Cartridge::WriteRam(uint16_t addr, uint8_t value, uint64_t now)
+{
+    if (RamMapped()) {
+        Ram()[addr & (RAM_BANK_SIZE - 1)] = value;
+    }
+    else if (type == MBC_3 && hasClock && ramEnabled && bankHigh >= 0x08 && bankHigh <= 0x0C) {
+        SetClock(bankHigh - 0x08, value, now);
+    }
+}
+
+uint64_t Cartridge::ClockSeconds(uint64_t now) const
+{
+    return clockHalted ? clockBase : clockBase + (now - clockStart) / CYCLES_PER_SECOND;
+}
+
+void Cartridge::LatchClock(uint64_t now)
+{
+    uint64_t seconds = ClockSeconds(now);
+    uint64_t days = seconds / 86400;
+
+    if (days > 511) {
+        // the counter wraps and the carry stays set until it's written back to 0
+        clockCarry = true;
+        clockBase -= (days / 512) * 512 * 86400;
+        seconds = ClockSeconds(now);
+        days = seconds / 86400;
+    }
+
+    clockLatched[0] = seconds % 60;
+    clockLatched[1] = (seconds / 60) % 60;
+    clockLatched[2] = (seconds / 3600) % 24;
+    clockLatched[3] = days & 0xFF;
+    clockLatched[4] = ((days >> 8) & 0x01) | (clockHalted ? 0x40 : 0) | (clockCarry ? 0x80 : 0);
+}
+
+void Cartridge::SetClock(uint8_t reg, uint8_t value, uint64_t now)
+{
+    uint64_t seconds = ClockSeconds(now);
+    uint64_t s = seconds % 60;
+    uint64_t m = (seconds / 60) % 60;
+    uint64_t h = (seconds / 3600) % 24;
+    uint64_t days = (seconds / 86400) % 512;
+
+    switch (reg) {
+    case 0: s = value % 60; break;
+    case 1: m = value % 60; break;
+    case 2: h = value % 24; break;
+    case 3: days = (days & 0x100) | value; break;
+    case 4:
+        days = (days & 0xFF) | ((value & 0x01) << 8);
+        clockHalted = (value & 0x40) != 0;
+        clockCarry = (value & 0x80) != 0;
+        break;
+    }
+
+    // restart counting from the new value
+    clockBase = ((days * 24 + h) * 60 + m) * 60 + s;
+    clockStart = now;
+    clockLatched[reg] = value;
+}
+
+void Cartridge::SaveState(StateWriter& state) const
+{
+    state.Value(ramEnabled);
+    state.Value(bankLow);
+    state.Value(bankHigh);
+    state.Value(bankingMode);
+    state.Value(clockBase);
+    state.Value(clockStart);
+    state.Value(clockHalted);
+    state.Value(clockCarry);
+    state.Value(clockLatched);
+    state.Value(latchWrite);
+}
+
+bool Cartridge::LoadState(StateReader& state)
+{
+    bool ok = state.Value(ramEnabled) && state.Value(bankLow) && state.Value(bankHigh) && state.Value(bankingMode)
+        && state.Value(clockBase) && state.Value(clockStart) && state.Value(clockHalted) && state.Value(clockCarry)
+        && state.Value(clockLatched) && state.Value(latchWrite);
+
+    Remap(); // bank0 / bankX / ramBank follow from the registers
+    return ok;
+}
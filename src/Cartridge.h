@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include "Rom.h"
+
+class StateWriter;
+class StateReader;
+
+/*
+
+Cartridge and its memory bank controller.
+
+The controller is picked from the header byte at 0x147: plain ROM (with or without RAM), MBC1, MBC3 (with the
+clock) or MBC5. Writes to 0x0000 - 0x7FFF go to the controller's registers, and all a bank switch does is work
+out which bytes 0x0000 - 0x3FFF, 0x4000 - 0x7FFF and 0xA000 - 0xBFFF show right now. The bus (Bus.cpp) maps its
+pages straight onto those, nothing is ever copied.
+
+*/
+
+class Cartridge
+{
+public:
+    enum Controller : uint8_t { MBC_NONE, MBC_1, MBC_3, MBC_5 };
+
+    static const uint32_t ROM_BANK_SIZE = 0x4000;
+    static const uint32_t RAM_BANK_SIZE = 0x2000;
+
+    // false if the header asks for a controller that isn't supported
+    bool Load(std::shared_ptr<const RomImage> image);
+
+    bool Loaded() const { return rom != nullptr; }
+    const RomImage* Image() const { return rom.get(); }
+    Controller Type() const { return type; }
+    const char* TypeName() const;
+    uint32_t HeaderHash() const; // of 0x134 - 0x14F, tells savestates / movies which ROM they belong to
+
+    // what each area shows right now, null when nothing is there (no cartridge / RAM disabled / clock register)
+    const uint8_t* Bank0() const { return Loaded() ? rom->Data() + bank0 * ROM_BANK_SIZE : nullptr; }
+    const uint8_t* BankX() const { return Loaded() ? rom->Data() + bankX * ROM_BANK_SIZE : nullptr; }
+    uint8_t* Ram() { return RamMapped() ? &ram[ramBank * RAM_BANK_SIZE] : nullptr; }
+    uint8_t* RamBytes() { return ram.data(); } // every bank, whatever is mapped
+    const uint8_t* RamBytes() const { return ram.data(); }
+    size_t RamSize() const { return ram.size(); }
+
+    uint32_t Bank0Number() const { return bank0; }
+    uint32_t BankXNumber() const { return bankX; }
+    uint32_t RamBankNumber() const { return ramBank; }
+
+    // controller registers, true if what's mapped changed
+    bool Write(uint16_t addr, uint8_t value, uint64_t now);
+
+    // 0xA000 - 0xBFFF while it isn't plain RAM, or while the bus has the page unmapped for its own reasons
+    uint8_t ReadRam(uint16_t addr);
+    void WriteRam(uint16_t addr, uint8_t value, uint64_t now);
+
+    // controller registers and clock, RAM is saved separately (RamBytes). the ROM has to be the same one
+    void SaveState(StateWriter& state) const;
+    bool LoadState(StateReader& state);
+
+private:
+    std::shared_ptr<const RomImage> rom; // shared with every other cartridge running the same image
+    std::vector<uint8_t> ram;
+    Controller type = MBC_NONE;
+    bool hasClock = false;
+
+    uint32_t romBanks = 0;
+    uint32_t ramBanks = 0;
+
+    // controller registers
+    bool ramEnabled = false;
+    uint16_t bankLow = 1;   // MBC1: 5 bits, MBC3: 7 bits, MBC5: 9 bits
+    uint8_t bankHigh = 0;   // MBC1: the 2 bit register, MBC3 / MBC5: RAM bank or clock register
+    bool bankingMode = false; // MBC1 mode select
+
+    // worked out from the registers by Remap
+    uint32_t bank0 = 0;
+    uint32_t bankX = 1;
+    uint32_t ramBank = 0;
+
+    // MBC3 clock, worked out from the cycle count whenever it's looked at instead of ticking
+    static const uint64_t CYCLES_PER_SECOND = 4194304;
+    uint64_t clockBase = 0;  // seconds it showed at clockStart
+    uint64_t clockStart = 0; // cycle count it was last set / restarted at
+    bool clockHalted = false;
+    bool clockCarry = false; // the day counter went past 511
+    uint8_t clockLatched[5] = {}; // S, M, H, DL, DH as they were when latched
+    uint8_t latchWrite = 0xFF;
+
+    bool RamMapped() const;
+    void Remap();
+    uint64_t ClockSeconds(uint64_t now) const;
+    void LatchClock(uint64_t now);
+    void SetClock(uint8_t reg, uint8_t value, uint64_t now);
+};
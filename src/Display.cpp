@@ -0,0 +1,487 @@
+#include "CPU.h"
+
+Display::Display(CPU& cpu)
+    :cpu(cpu), kernels(&GetPixelKernels(BestPixelIsa()))
+{
+    for (Layer& layer : layers) {
+        layer.pixels.resize(LAYER_SIZE * LAYER_SIZE); // 64KB each, too much to keep inside the CPU
+        layer.unsignedTiles = false;
+    }
+    InvalidateCaches();
+}
+
+void Display::Reset(uint64_t now)
+{
+    cpu.StoreByte(LCDC, 0x91); // what the boot ROM leaves it at
+    cpu.StoreByte(STAT, 0x80);
+    cpu.StoreByte(BGP, 0xFC);
+    SetLine(0);
+    EnterMode(MODE_OAM, now + OAM_CYCLES);
+    ScheduleNext();
+}
+
+bool Display::Enabled() const
+{
+    return (cpu.Mem(LCDC) & 0x80) != 0;
+}
+
+void Display::Write(uint16_t addr, uint8_t value, uint64_t now)
+{
+    CatchUp(now);
+
+    switch (addr) {
+    case LCDC: {
+        bool wasOn = Enabled();
+        cpu.StoreByte(LCDC, value);
+
+        if (wasOn && !Enabled()) {
+            // LY sits at 0 in mode 0 until it's turned back on
+            SetLine(0);
+            mode = MODE_HBLANK;
+            modeEnd = Scheduler::NEVER;
+            UpdateStat(false);
+        }
+        else if (!wasOn && Enabled()) {
+            SetLine(0);
+            EnterMode(MODE_OAM, now + OAM_CYCLES);
+        }
+        ScheduleNext();
+        break;
+    }
+    case STAT:
+        // only the interrupt selects are writable
+        cpu.StoreByte(STAT, 0x80 | (value & 0x78) | (cpu.Mem(STAT) & 0x07));
+        ScheduleNext();
+        break;
+    case LY:
+        break; // read only
+    case LYC:
+        cpu.StoreByte(LYC, value);
+        UpdateStat(false);
+        ScheduleNext();
+        break;
+    default:
+        cpu.StoreByte(addr, value); // scroll, palettes and the window, only drawing looks at them
+        break;
+    }
+}
+
+void Display::OnEvent(uint64_t when)
+{
+    CatchUp(when);
+    ScheduleNext();
+}
+
+void Display::SetLockstep(bool on)
+{
+    lockstep = on;
+    ScheduleNext();
+}
+
+void Display::NextMode()
+{
+    uint64_t when = modeEnd;
+
+    switch (mode) {
+    case MODE_OAM:
+        EnterMode(MODE_DRAWING, when + DRAWING_CYCLES);
+        break;
+    case MODE_DRAWING:
+        RenderLine();
+        EnterMode(MODE_HBLANK, when + HBLANK_CYCLES);
+        break;
+    case MODE_HBLANK:
+        SetLine(line + 1);
+        if (line == VISIBLE_LINES) {
+            cpu.RequestInterrupt(0); // VBlank
+            EnterMode(MODE_VBLANK, when + CYCLES_PER_LINE);
+        }
+        else {
+            EnterMode(MODE_OAM, when + OAM_CYCLES);
+        }
+        break;
+    case MODE_VBLANK:
+        if (line + 1 == LINES) {
+            SetLine(0);
+            EnterMode(MODE_OAM, when + OAM_CYCLES);
+        }
+        else {
+            SetLine(line + 1);
+            modeEnd = when + CYCLES_PER_LINE;
+        }
+        break;
+    }
+}
+
+void Display::EnterMode(uint8_t newMode, uint64_t until)
+{
+    mode = newMode;
+    modeEnd = until;
+    UpdateStat(true);
+}
+
+void Display::SetLine(uint8_t newLine)
+{
+    line = newLine;
+    cpu.StoreByte(LY, line);
+    UpdateStat(false);
+}
+
+void Display::UpdateStat(bool modeChanged)
+{
+    uint8_t stat = cpu.Mem(STAT);
+    bool coincidence = line == cpu.Mem(LYC);
+    bool wasCoincidence = (stat & 0x04) != 0;
+
+    stat = (stat & 0xF8) | (coincidence ? 0x04 : 0) | mode;
+    cpu.StoreByte(STAT, stat);
+
+    bool request = coincidence && !wasCoincidence && (stat & 0x40);
+    if (modeChanged) {
+        request |= (mode == MODE_HBLANK && (stat & 0x08))
+            || (mode == MODE_VBLANK && (stat & 0x10))
+            || (mode == MODE_OAM && (stat & 0x20));
+    }
+
+    if (request) {
+        cpu.RequestInterrupt(1); // LCD STAT
+    }
+}
+
+void Display::ScheduleNext()
+{
+    uint64_t when = lockstep ? modeEnd : NextInterrupt();
+    if (when == Scheduler::NEVER) {
+        cpu.scheduler.Cancel(EVENT_PPU);
+        return;
+    }
+
+    cpu.scheduler.Schedule(EVENT_PPU, when);
+    cpu.EndRunBy(when); // a write to STAT or LYC can make it sooner than the core was going to stop
+}
+
+uint64_t Display::LineEnd() const
+{
+    switch (mode) {
+    case MODE_OAM: return modeEnd + DRAWING_CYCLES + HBLANK_CYCLES;
+    case MODE_DRAWING: return modeEnd + HBLANK_CYCLES;
+    default: return modeEnd;
+    }
+}
+
+uint64_t Display::NextInterrupt() const
+{
+    if (modeEnd == Scheduler::NEVER) {
+        return Scheduler::NEVER; // LCD off
+    }
+
+    uint8_t stat = cpu.Mem(STAT);
+    if ((stat & 0x68) == 0) {
+        // no HBlank, OAM or LY=LYC interrupts (the VBlank one goes with VBlank), so it's the start of line 144
+        int lines = line < VISIBLE_LINES ? VISIBLE_LINES - 1 - line : LINES - 1 - line + VISIBLE_LINES;
+        return LineEnd() + static_cast<uint64_t>(lines) * CYCLES_PER_LINE;
+    }
+
+    // the same steps NextMode takes, only looking at what they'd request. VBlank comes round every frame so
+    // this always finds one
+    uint8_t lyc = cpu.Mem(LYC);
+    uint8_t nextMode = mode;
+    int nextLine = line;
+    uint64_t when = modeEnd;
+
+    for (;;) {
+        switch (nextMode) {
+        case MODE_OAM:
+            nextMode = MODE_DRAWING;
+            when += DRAWING_CYCLES;
+            break;
+        case MODE_DRAWING:
+            if (stat & 0x08) {
+                return when;
+            }
+            nextMode = MODE_HBLANK;
+            when += HBLANK_CYCLES;
+            break;
+        case MODE_HBLANK:
+            nextLine++;
+            if (nextLine == VISIBLE_LINES || (nextLine == lyc && (stat & 0x40)) || (stat & 0x20)) {
+                return when;
+            }
+            nextMode = MODE_OAM;
+            when += OAM_CYCLES;
+            break;
+        case MODE_VBLANK:
+            nextLine = nextLine + 1 == LINES ? 0 : nextLine + 1;
+            if ((nextLine == lyc && (stat & 0x40)) || (nextLine == 0 && (stat & 0x20))) {
+                return when;
+            }
+            if (nextLine == 0) {
+                nextMode = MODE_OAM;
+                when += OAM_CYCLES;
+            }
+            else {
+                when += CYCLES_PER_LINE;
+            }
+            break;
+        }
+    }
+}
+
+void Display::WriteVram(uint16_t addr, uint8_t value)
+{
+    if (cpu.Mem(addr) == value) {
+        return; // games rewrite the same tiles and maps all the time, nothing to draw again
+    }
+    CatchUp(cpu.cycles);
+    cpu.StoreByte(addr, value);
+
+    if (addr < 0x9800) {
+        int tile = (addr - 0x8000) >> 4;
+        tileDecoded[tile] = false;
+        for (Layer& layer : layers) {
+            layer.dirtyTiles[tile >> 6] |= 1ull << (tile & 63);
+            layer.pending = true;
+        }
+    }
+    else {
+        Layer& layer = layers[addr >= 0x9C00];
+        int entry = addr & (MAP_ENTRIES - 1);
+        layer.dirtyEntries[entry >> 6] |= 1ull << (entry & 63);
+        layer.pending = true;
+    }
+}
+
+void Display::WriteOam(uint16_t addr, uint8_t value)
+{
+    if (cpu.Mem(addr) != value) {
+        CatchUp(cpu.cycles);
+        cpu.StoreByte(addr, value);
+        spritesChanged = true;
+    }
+}
+
+void Display::LoadOam(const uint8_t* bytes)
+{
+    CatchUp(cpu.cycles);
+    std::memmove(&cpu.Mem(0xFE00), bytes, 0xA0); // DMA from OAM onto itself does nothing, but it can be asked to
+    spritesChanged = true;
+}
+
+void Display::InvalidateCaches()
+{
+    spritesChanged = true;
+
+    std::fill(tileDecoded, tileDecoded + TILES, false);
+
+    for (Layer& layer : layers) {
+        std::fill(layer.dirtyEntries, layer.dirtyEntries + MAP_ENTRIES / 64, ~0ull);
+        std::fill(layer.dirtyTiles, layer.dirtyTiles + TILES / 64, 0);
+        layer.pending = true;
+    }
+}
+
+const uint8_t* Display::UpdateLayer(int index, bool unsignedTiles)
+{
+    Layer& layer = layers[index];
+    if (!layer.pending && layer.unsignedTiles == unsignedTiles) {
+        return layer.pixels.data();
+    }
+
+    if (layer.unsignedTiles != unsignedTiles) {
+        // every entry points at a different tile now
+        std::fill(layer.dirtyEntries, layer.dirtyEntries + MAP_ENTRIES / 64, ~0ull);
+        layer.unsignedTiles = unsignedTiles;
+    }
+
+    const uint8_t* map = &cpu.Mem(index ? 0x9C00 : 0x9800);
+
+    // entries that use a tile that changed. a map doesn't say which entries use a tile, but checking all 1024
+    // only happens when tiles were written, usually once a frame
+    bool tilesWritten = false;
+    for (uint64_t bits : layer.dirtyTiles) {
+        tilesWritten |= bits != 0;
+    }
+    if (tilesWritten) {
+        for (int entry = 0; entry < MAP_ENTRIES; entry++) {
+            int tile = unsignedTiles ? map[entry] : 256 + static_cast<int8_t>(map[entry]);
+            if ((layer.dirtyTiles[tile >> 6] >> (tile & 63)) & 1) {
+                layer.dirtyEntries[entry >> 6] |= 1ull << (entry & 63);
+            }
+        }
+        std::fill(layer.dirtyTiles, layer.dirtyTiles + TILES / 64, 0);
+    }
+
+    for (int word = 0; word < MAP_ENTRIES / 64; word++) {
+        uint64_t bits = layer.dirtyEntries[word];
+        for (int entry = word * 64; bits; entry++, bits >>= 1) {
+            if (bits & 1) {
+                DrawEntry(layer, map, entry);
+            }
+        }
+        layer.dirtyEntries[word] = 0;
+    }
+
+    layer.pending = false;
+    return layer.pixels.data();
+}
+
+void Display::DrawEntry(Layer& layer, const uint8_t* map, int entry)
+{
+    uint8_t number = map[entry];
+    int tile = layer.unsignedTiles ? number : 256 + static_cast<int8_t>(number); // 0x8800 mode counts from 0x9000
+
+    uint8_t* out = layer.pixels.data() + (entry >> 5) * 8 * LAYER_SIZE + (entry & 31) * 8;
+    for (int row = 0; row < 8; row++) {
+        std::memcpy(out + row * LAYER_SIZE, TileRow(tile, row), 8);
+    }
+}
+
+void Display::DecodeTile(int tile)
+{
+    // two bit planes per row, bit 7 is the leftmost pixel
+    kernels->decodeTile(&cpu.Mem(0x8000 + tile * 16), tiles[tile]);
+    tileDecoded[tile] = true;
+}
+
+const uint8_t* Display::TileRow(int tile, int row)
+{
+    if (!tileDecoded[tile]) {
+        DecodeTile(tile);
+    }
+    return tiles[tile] + row * 8;
+}
+
+void Display::RenderLine()
+{
+    uint8_t lcdc = cpu.Mem(LCDC);
+
+    if (line == 0) {
+        windowLine = 0;
+    }
+
+    // BG / window color numbers before the palette (sprites behind the background need them), then the shades
+    uint8_t colors[PAD + WIDTH + PAD] = {}; // BG off is color 0 everywhere
+    uint8_t shades[PAD + WIDTH + PAD] = {}; // and white whatever BGP says
+
+    if (lcdc & 0x01) {
+        bool unsignedTiles = (lcdc & 0x10) != 0;
+
+        // the background wraps round, so it's the end of the layer's line and then its start
+        const uint8_t* background = UpdateLayer((lcdc >> 3) & 1, unsignedTiles);
+        const uint8_t* row = background + static_cast<uint8_t>(line + cpu.Mem(SCY)) * LAYER_SIZE;
+        int scx = cpu.Mem(SCX);
+        int first = std::min(WIDTH, LAYER_SIZE - scx);
+        std::memcpy(colors + PAD, row + scx, first);
+        std::memcpy(colors + PAD + first, row, WIDTH - first);
+
+        // the window always starts from the left of its map and can't get far enough across to wrap
+        int windowX = cpu.Mem(WX) - 7;
+        if ((lcdc & 0x20) && line >= cpu.Mem(WY) && windowX < WIDTH) {
+            const uint8_t* window = UpdateLayer((lcdc >> 6) & 1, unsignedTiles);
+            int from = std::max(windowX, 0);
+            std::memcpy(colors + PAD + from, window + windowLine * LAYER_SIZE + (from - windowX), WIDTH - from);
+            windowLine++;
+        }
+
+        kernels->applyPalette(colors + PAD, shades + PAD, WIDTH, cpu.Mem(BGP));
+    }
+
+    if (lcdc & 0x02) {
+        RenderSprites(lcdc, colors, shades);
+    }
+
+    std::memcpy(framebuffer + line * WIDTH, shades + PAD, WIDTH);
+}
+
+// colors and shades are whole padded lines
+void Display::RenderSprites(uint8_t lcdc, const uint8_t* colors, uint8_t* shades)
+{
+    const uint8_t* oam = &cpu.Mem(0xFE00);
+    int height = lcdc & 0x04 ? 16 : 8;
+
+    if (spritesChanged || height != spriteHeight) {
+        BuildSpriteLists(height);
+    }
+
+    const uint8_t* found = lineSprites[line];
+    int count = lineSpriteCount[line];
+
+    // a pixel belongs to the first sprite with something there, even if the background ends up hiding it
+    uint8_t taken[PAD + WIDTH + PAD] = {};
+
+    for (int i = 0; i < count; i++) {
+        const uint8_t* sprite = oam + found[i] * 4;
+        int left = sprite[1] - 8;
+        if (left <= -8 || left >= WIDTH) {
+            continue; // counts towards the 10 but can't be seen
+        }
+
+        uint8_t flags = sprite[3];
+        uint8_t palette = cpu.Mem(flags & 0x10 ? OBP1 : OBP0);
+
+        int row = line - (sprite[0] - 16);
+        if (flags & 0x40) {
+            row = height - 1 - row; // Y flip
+        }
+
+        int tile = height == 16 ? (sprite[2] & 0xFE) + (row >> 3) : sprite[2];
+        uint64_t pixels;
+        std::memcpy(&pixels, TileRow(tile, row & 7), 8);
+        if (flags & 0x20) {
+            pixels = ReverseBytes(pixels); // X flip
+        }
+
+        int at = PAD + left;
+        kernels->blendSprite(reinterpret_cast<const uint8_t*>(&pixels), colors + at, taken + at, shades + at,
+            palette, (flags & 0x80) != 0);
+    }
+}
+
+// OAM search for every line at once
+void Display::BuildSpriteLists(int height)
+{
+    const uint8_t* oam = &cpu.Mem(0xFE00);
+    std::memset(lineSpriteCount, 0, sizeof(lineSpriteCount));
+
+    // in OAM order, so each line ends up with the first 10 that are on it, whether they're on screen or not
+    for (int i = 0; i < 40; i++) {
+        int top = oam[i * 4] - 16;
+        int first = std::max(top, 0);
+        int last = std::min(top + height, static_cast<int>(HEIGHT));
+
+        for (int y = first; y < last; y++) {
+            uint8_t& count = lineSpriteCount[y];
+            if (count == MAX_SPRITES) {
+                continue;
+            }
+
+            // lower X is drawn first, then lower OAM index. everything already there came earlier in OAM,
+            // so this one goes after every sprite with the same X or less
+            uint8_t* sprites = lineSprites[y];
+            int at = count;
+            for (; at > 0 && oam[sprites[at - 1] * 4 + 1] > oam[i * 4 + 1]; at--) {
+                sprites[at] = sprites[at - 1];
+            }
+            sprites[at] = static_cast<uint8_t>(i);
+            count++;
+        }
+    }
+
+    spritesChanged = false;
+    spriteHeight = height;
+}
+
+void Display::SaveState(StateWriter& state) const
+{
+    // LY / STAT themselves are in the I/O registers, the framebuffer gets drawn again and the tiles decoded again
+    state.Value(mode);
+    state.Value(line);
+    state.Value(windowLine);
+    state.Value(modeEnd);
+}
+
+bool Display::LoadState(StateReader& state)
+{
+    InvalidateCaches(); // VRAM and OAM are about to be replaced
+    return state.Value(mode) && state.Value(line) && state.Value(windowLine) && state.Value(modeEnd);
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "PixelKernels.h"
+
+class CPU;
+class StateWriter;
+class StateReader;
+
+/*
+
+LCD controller.
+
+Every line is 456 cycles: OAM scan (mode 2, 80), drawing (mode 3, 172) and HBlank (mode 0, 204).
+Lines 144 - 153 are VBlank (mode 1). Each mode change is when LY, the STAT mode bits and the LY=LYC flag
+change and the VBlank / STAT interrupts get requested.
+
+The mode changes aren't run as they happen though. The PPU only knows when its current mode ends and catches
+up to the present (CatchUp) when something could tell the difference: the CPU reading LY or STAT, writing any
+PPU register, VRAM or OAM, an OAM DMA, or CPU::Run handing back to the host. The only changes that have to
+happen on time are the ones that request an interrupt, so EVENT_PPU is only scheduled for the next one of
+those, worked out from how STAT and LYC are set. With the STAT interrupts off that's VBlank, one event a frame
+instead of four a line. The CPU gets the same answers either way: SetLockstep puts an event on every mode
+change instead, which is what --ppu-check compares against.
+
+Lines are drawn whole at the end of mode 3: the background, the window and the sprites go into the
+framebuffer, 160x144 shades (0 - 3, after the palettes) one line after another.
+
+Which sprites are on which line (at most 10, the first ones in OAM order, drawn lowest X first) doesn't get
+searched for every line. The whole frame's lists are built in one pass over OAM, and only again once OAM has
+been written or the sprite size changed. OAM writes come through WriteOam and OAM DMA through LoadOam, one
+160 byte copy.
+
+Tiles are decoded from their 2 bit planes to one color number per byte the first time they're drawn and kept
+that way. VRAM writes come through WriteVram (the bus has no write pointer for VRAM pages), which throws away
+only the tile that was written, so a tile that doesn't change is never decoded again.
+
+The background isn't drawn tile by tile either. Each of the two tile maps has a layer, the whole 256x256
+picture it makes as color numbers, and a BG or window line is a copy out of that (wrapping round at SCX).
+Map writes mark their entry, tile writes mark the tile, and before a layer gets used the entries that changed or
+use a tile that changed are drawn again, from the decoded tiles. With nothing written a frame is just the copies.
+
+Decoding, the palettes and sprite blending are done 8 to 32 pixels at a time by whichever PixelKernels the
+CPU this runs on can take. Lines are built in a buffer with 8 spare pixels on either side so sprites hanging
+off the edges don't need clipping.
+
+*/
+
+class Display
+{
+public:
+    static const uint32_t CYCLES_PER_LINE = 456;
+    static const uint8_t VISIBLE_LINES = 144;
+    static const uint8_t LINES = 154;
+    static const uint32_t CYCLES_PER_FRAME = CYCLES_PER_LINE * LINES;
+
+    // I/O registers this class owns
+    static const uint16_t LCDC = 0xFF40;
+    static const uint16_t STAT = 0xFF41;
+    static const uint16_t SCY = 0xFF42;
+    static const uint16_t SCX = 0xFF43;
+    static const uint16_t LY = 0xFF44;
+    static const uint16_t LYC = 0xFF45;
+    static const uint16_t BGP = 0xFF47;
+    static const uint16_t OBP0 = 0xFF48;
+    static const uint16_t OBP1 = 0xFF49;
+    static const uint16_t WY = 0xFF4A;
+    static const uint16_t WX = 0xFF4B;
+
+    static const int WIDTH = 160;
+    static const int HEIGHT = VISIBLE_LINES;
+
+    explicit Display(CPU& cpu);
+
+    void Reset(uint64_t now); // LCD on, start of line 0
+    void Write(uint16_t addr, uint8_t value, uint64_t now);
+    void OnEvent(uint64_t when);
+
+    // runs every mode change up to `now`
+    void CatchUp(uint64_t now)
+    {
+        while (modeEnd <= now) {
+            NextMode();
+        }
+    }
+
+    void SetLockstep(bool on); // an EVENT_PPU for every mode change, to check the lazy version against
+    bool Lockstep() const { return lockstep; }
+
+    void WriteVram(uint16_t addr, uint8_t value);
+    void WriteOam(uint16_t addr, uint8_t value);
+    void LoadOam(const uint8_t* bytes); // all 160 bytes at once, for OAM DMA
+    void InvalidateCaches(); // VRAM or OAM changed behind the bus' back, forgets everything worked out from them
+
+    void SaveState(StateWriter& state) const;
+    bool LoadState(StateReader& state);
+
+    uint8_t Mode() const { return mode; }
+    uint8_t Line() const { return line; }
+    const uint8_t* Framebuffer() const { return framebuffer; } // WIDTH * HEIGHT shades, 0 is the lightest
+
+    void UsePixelIsa(PixelIsa isa) { kernels = &GetPixelKernels(isa); } // the best one there is by default
+    PixelIsa GetPixelIsa() const { return kernels->isa; }
+
+private:
+    enum Modes : uint8_t { MODE_HBLANK, MODE_VBLANK, MODE_OAM, MODE_DRAWING };
+
+    static const uint32_t OAM_CYCLES = 80;
+    static const uint32_t DRAWING_CYCLES = 172;
+    static const uint32_t HBLANK_CYCLES = CYCLES_PER_LINE - OAM_CYCLES - DRAWING_CYCLES;
+
+    static const int TILES = 384; // 0x8000 - 0x97FF
+    static const int MAX_SPRITES = 10; // per line
+    static const int PAD = 8; // spare pixels either side of a line
+    static const int MAP_ENTRIES = 32 * 32;
+    static const int LAYER_SIZE = 256;
+
+    CPU& cpu;
+    const PixelKernels* kernels;
+    bool lockstep = false;
+    uint8_t mode = MODE_OAM;
+    uint8_t line = 0;
+    uint64_t modeEnd = UINT64_MAX; // Scheduler::NEVER while the LCD is off
+    uint8_t windowLine = 0; // the window has its own line counter, it only moves on lines it was drawn on
+
+    uint8_t framebuffer[WIDTH * HEIGHT]{};
+
+    uint8_t tiles[TILES][64]; // color numbers, 8 per row
+    bool tileDecoded[TILES]{};
+
+    // what one tile map (0x9800 or 0x9C00) looks like
+    struct Layer
+    {
+        std::vector<uint8_t> pixels; // LAYER_SIZE * LAYER_SIZE color numbers
+        uint64_t dirtyEntries[MAP_ENTRIES / 64];
+        uint64_t dirtyTiles[TILES / 64]; // written since the layer was last brought up to date
+        bool pending;                    // any of the above
+        bool unsignedTiles;              // the LCDC bit 4 it was drawn with
+    };
+
+    Layer layers[2];
+
+    // sprites on each line, in the order they're drawn
+    uint8_t lineSprites[HEIGHT][MAX_SPRITES];
+    uint8_t lineSpriteCount[HEIGHT];
+    bool spritesChanged = true; // OAM was written since the lists were built
+    int spriteHeight = 0;       // what they were built for
+
+    bool Enabled() const;
+    void NextMode(); // the mode change at modeEnd
+    void EnterMode(uint8_t newMode, uint64_t until);
+    void SetLine(uint8_t newLine);
+    void UpdateStat(bool modeChanged);
+    void ScheduleNext(); // EVENT_PPU for the next mode change that requests an interrupt (every one in lockstep)
+    uint64_t NextInterrupt() const;
+    uint64_t LineEnd() const; // when the line it's on is over
+
+    void RenderLine();
+    const uint8_t* UpdateLayer(int map, bool unsignedTiles); // the layer's pixels, all up to date
+    void DrawEntry(Layer& layer, const uint8_t* map, int entry);
+    void RenderSprites(uint8_t lcdc, const uint8_t* colors, uint8_t* shades);
+    void BuildSpriteLists(int height);
+    const uint8_t* TileRow(int tile, int row); // 8 color numbers, decoded first if it has to be
+    void DecodeTile(int tile);
+};
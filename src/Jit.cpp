@@ -0,0 +1,648 @@
+/*
+
+x86-64 block compiler (GB_CORE_JIT).
+
+Blocks from the block cache (BlockCache.cpp) that live in ROM and have run GB_JIT_THRESHOLD times get turned
+into native code. NOP, LD r,r' / r,d8, the 8 bit ALU ops (A,r / A,d8 / A,(HL)), INC r / DEC r, CPL, SCF and
+CCF are written out directly, the arithmetic ones as a load from the same ALU tables the interpreter uses.
+LD r,(HL), LD (HL),r and LD (HL),d8 look at the page tables inline the way ReadByte / WriteByte do and only
+call the handler when the page is null. Everything else becomes a direct call to the handler the interpreter
+would have used, so both backends share the rest of the opcode logic. With GB_LAZY_FLAGS the flag setting ops
+are left to the handlers too, F isn't kept where the generated code could write it.
+
+The pc and cycle count are known at every point in a block so they're only written back when needed, before a
+handler call and on the way out. After every instruction the generated code does the same checks RunBlocks does
+(pc went where it should, nothing wrote over cached code, cycle budget not used up) and leaves through an exit
+stub that stores the pc, cycles, opcode and operand exactly as the interpreter would have left them.
+
+Blocks outside ROM (code in RAM can change under us) and blocks with I/O opcodes are left to the interpreter.
+
+Each op gets its own exit, since the cycle budget can run out after any of them. The exits only load what they
+leave behind into registers and jump to a shared tail that stores it, so a NOP comes to about 30 bytes and a
+block is quick to write out and copy in.
+
+Where it stands (wall time for 3000 frames, GCC -O2, GB_JIT_THRESHOLD 64):
+    ROMs/02.gb                       CACHED 0.49 s  JIT 0.32 s
+    ROMs/07.gb                       CACHED 0.46 s  JIT 0.31 s
+    ROMs/10.gb                       CACHED 0.45 s  JIT 0.30 s
+    ALU / LD heavy loop in ROM       CACHED ~700    JIT ~2600 Mcycles/s
+Past their first few frames the test ROMs spend their time running through a long stretch of ROM, and where a
+block gets left because the budget ran out decides where the next one starts. That leaves ~15,000 blocks that
+only run a few dozen times each and ~250 that run all the time. A threshold of 16 compiles 8,000 of them and
+gets about 0.36 s. See GB_JIT_THRESHOLD in CPU.h.
+
+Registers while a block runs:
+    rbx = CPU*
+    r12 = cycles left before the deadline when the block was entered
+    r13 = blockGeneration when the block was entered
+
+*/
+
+#include "CPU.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const size_t JIT_ARENA_SIZE = 16 << 20;
+
+JitArena::JitArena(size_t size)
+    : size(size)
+{
+    // never writable and executable at the same time: one block of shared memory, mapped once read/write for
+    // Place to copy into and once read/execute to run from
+#if defined(_WIN32)
+    HANDLE section = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_EXECUTE_READWRITE,
+        static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), nullptr);
+    if (section) {
+        writable = static_cast<uint8_t*>(MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, size));
+        executable = static_cast<uint8_t*>(MapViewOfFile(section, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, size));
+        CloseHandle(section); // the views keep it alive
+    }
+#else
+#if defined(__linux__)
+    int file = memfd_create("GameboyEmulator JIT", MFD_CLOEXEC);
+#else
+    // anywhere else it's a named one that goes away again straight after, one per arena
+    char name[64];
+    std::snprintf(name, sizeof(name), "/GameboyEmulator-JIT-%ld-%p", static_cast<long>(getpid()), static_cast<void*>(this));
+    int file = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (file >= 0) {
+        shm_unlink(name);
+    }
+#endif
+    if (file >= 0) {
+        if (ftruncate(file, static_cast<off_t>(size)) == 0) {
+            void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+            writable = view != MAP_FAILED ? static_cast<uint8_t*>(view) : nullptr;
+            view = mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_SHARED, file, 0);
+            executable = view != MAP_FAILED ? static_cast<uint8_t*>(view) : nullptr;
+        }
+        close(file); // the mappings keep it alive
+    }
+#endif
+
+    if (!writable || !executable) {
+        std::cerr << "Error: Could not get executable memory, the JIT is off" << std::endl;
+        Release();
+    }
+}
+
+JitArena::~JitArena()
+{
+    Release();
+}
+
+void JitArena::Release()
+{
+#if defined(_WIN32)
+    if (writable) {
+        UnmapViewOfFile(writable);
+    }
+    if (executable) {
+        UnmapViewOfFile(executable);
+    }
+#else
+    if (writable) {
+        munmap(writable, size);
+    }
+    if (executable) {
+        munmap(executable, size);
+    }
+#endif
+    writable = nullptr;
+    executable = nullptr;
+}
+
+void* JitArena::Place(const uint8_t* code, size_t length)
+{
+    size_t aligned = (used + 15) & ~static_cast<size_t>(15);
+    if (!executable || aligned + length > size) {
+        return nullptr;
+    }
+
+    std::memcpy(writable + aligned, code, length);
+
+    used = aligned + length;
+    return executable + aligned;
+}
+
+// Just the handful of instructions the compiler needs. Every memory operand is [rbx + disp32].
+class X64Emitter
+{
+public:
+    std::vector<uint8_t> code;
+
+    void Byte(uint8_t b) { code.push_back(b); }
+
+    void Imm16(uint16_t v) { Byte(v & 0xFF); Byte(v >> 8); }
+
+    void Imm32(uint32_t v)
+    {
+        for (int i = 0; i < 4; i++) {
+            Byte((v >> (i * 8)) & 0xFF);
+        }
+    }
+
+    void Imm64(uint64_t v)
+    {
+        for (int i = 0; i < 8; i++) {
+            Byte((v >> (i * 8)) & 0xFF);
+        }
+    }
+
+    // modrm for [rbx + disp32] with the given reg field
+    void RbxDisp(uint8_t reg, int32_t disp) { Byte(0x83 | (reg << 3)); Imm32(static_cast<uint32_t>(disp)); }
+
+    void Prologue()
+    {
+        Byte(0x53);                     // push rbx
+        Byte(0x41); Byte(0x54);         // push r12
+        Byte(0x41); Byte(0x55);         // push r13
+        Byte(0x48); Byte(0x83); Byte(0xEC); Byte(0x20); // sub rsp, 32 (shadow space on Windows, keeps rsp aligned)
+#if defined(_WIN32)
+        Byte(0x48); Byte(0x89); Byte(0xCB); // mov rbx, rcx
+        Byte(0x41); Byte(0x89); Byte(0xD4); // mov r12d, edx
+#else
+        Byte(0x48); Byte(0x89); Byte(0xFB); // mov rbx, rdi
+        Byte(0x41); Byte(0x89); Byte(0xF4); // mov r12d, esi
+#endif
+    }
+
+    void Epilogue()
+    {
+        Byte(0x48); Byte(0x83); Byte(0xC4); Byte(0x20); // add rsp, 32
+        Byte(0x41); Byte(0x5D);         // pop r13
+        Byte(0x41); Byte(0x5C);         // pop r12
+        Byte(0x5B);                     // pop rbx
+        Byte(0xC3);                     // ret
+    }
+
+    void LoadR13(int32_t disp) { Byte(0x44); Byte(0x8B); RbxDisp(5, disp); }   // mov r13d, [rbx+disp]
+    void CmpR13(int32_t disp) { Byte(0x44); Byte(0x3B); RbxDisp(5, disp); }    // cmp r13d, [rbx+disp]
+    void CmpR12(uint32_t v) { Byte(0x41); Byte(0x81); Byte(0xFC); Imm32(v); } // cmp r12d, imm32
+
+    void Store8(int32_t disp, uint8_t v) { Byte(0xC6); RbxDisp(0, disp); Byte(v); }                     // mov byte [rbx+disp], imm8
+    void Store16(int32_t disp, uint16_t v) { Byte(0x66); Byte(0xC7); RbxDisp(0, disp); Imm16(v); }       // mov word [rbx+disp], imm16
+    void Cmp16(int32_t disp, uint16_t v) { Byte(0x66); Byte(0x81); RbxDisp(7, disp); Imm16(v); }         // cmp word [rbx+disp], imm16
+    void Add16(int32_t disp, int8_t v) { Byte(0x66); Byte(0x83); RbxDisp(0, disp); Byte(static_cast<uint8_t>(v)); } // add word [rbx+disp], imm8
+    void Add64(int32_t disp, uint32_t v) { Byte(0x48); Byte(0x81); RbxDisp(0, disp); Imm32(v); }        // add qword [rbx+disp], imm32
+
+    void MoveRaxImm64(uint64_t v) { Byte(0x48); Byte(0xB8); Imm64(v); }                           // mov rax, imm64
+    void Store16Ax(int32_t disp) { Byte(0x66); Byte(0x89); RbxDisp(0, disp); }                    // mov word [rbx+disp], ax
+    void ShrRax16() { Byte(0x48); Byte(0xC1); Byte(0xE8); Byte(16); }                              // shr rax, 16
+    void Add64Rcx(int32_t disp) { Byte(0x48); Byte(0x01); RbxDisp(1, disp); }                     // add qword [rbx+disp], rcx
+
+    void Move8(int32_t dst, int32_t src)
+    {
+        Byte(0x0F); Byte(0xB6); RbxDisp(0, src); // movzx eax, byte [rbx+src]
+        Byte(0x88); RbxDisp(0, dst);             // mov byte [rbx+dst], al
+    }
+
+    // scratch registers are eax, ecx and edx, numbered the way the encoding wants them (ah is 4 as a byte register)
+    enum { EAX = 0, ECX = 1, EDX = 2, AH = 4 };
+
+    void Load8(uint8_t reg, int32_t disp) { Byte(0x0F); Byte(0xB6); RbxDisp(reg, disp); }  // movzx reg, byte [rbx+disp]
+    void Store8Reg(int32_t disp, uint8_t reg) { Byte(0x88); RbxDisp(reg, disp); }             // mov byte [rbx+disp], reg8
+    void Not8(int32_t disp) { Byte(0xF6); RbxDisp(2, disp); }                                 // not byte [rbx+disp]
+    void MoveImm(uint8_t reg, uint32_t v) { Byte(0xB8 + reg); Imm32(v); }                    // mov reg, imm32
+    void OrReg(uint8_t dst, uint8_t src) { Byte(0x09); Byte(0xC0 | (src << 3) | dst); }      // or dst, src
+    void AndImm(uint8_t reg, uint32_t v) { Byte(0x81); Byte(0xE0 | reg); Imm32(v); }         // and reg, imm32
+    void ShlImm(uint8_t reg, uint8_t n) { Byte(0xC1); Byte(0xE0 | reg); Byte(n); }           // shl reg, n
+
+    // al op= cl, for AND (0x20), XOR (0x30) and OR (0x08)
+    void AluAlCl(uint8_t code) { Byte(code); Byte(0xC8); }
+
+    // al op= imm8, for AND (0x24), XOR (0x34) and OR (0x0C)
+    void AluAlImm(uint8_t code, uint8_t v) { Byte(code); Byte(v); }
+
+    // cl = al == 0 ? 0x80 : 0, then | extra
+    void ZeroFlag(uint8_t extra)
+    {
+        Byte(0x84); Byte(0xC0);                 // test al, al
+        Byte(0x0F); Byte(0x94); Byte(0xC1);     // sete cl
+        Byte(0xC0); Byte(0xE1); Byte(7);        // shl cl, 7
+        if (extra) {
+            Byte(0x80); Byte(0xC9); Byte(extra); // or cl, extra
+        }
+    }
+
+    // eax = table[eax], one of the ALU tables (ALUTables.h)
+    void TableLookup(const uint16_t* table)
+    {
+        Byte(0x48); Byte(0xBA); Imm64(reinterpret_cast<uint64_t>(table)); // mov rdx, imm64
+        Byte(0x0F); Byte(0xB7); Byte(0x04); Byte(0x42);                   // movzx eax, word [rdx+rax*2]
+    }
+
+    // rax = pages[high], returns where the rel32 of the jump taken for a null page is
+    size_t LoadPage(int32_t pages, int32_t high)
+    {
+        Load8(EAX, high);
+        Byte(0x48); Byte(0x8B); Byte(0x84); Byte(0xC3); Imm32(static_cast<uint32_t>(pages)); // mov rax, [rbx+rax*8+pages]
+        Byte(0x48); Byte(0x85); Byte(0xC0);                                                 // test rax, rax
+        Byte(0x0F); Byte(0x84); Imm32(0);                                                   // jz rel32
+        return code.size() - 4;
+    }
+
+    void ReadPage() { Byte(0x0F); Byte(0xB6); Byte(0x0C); Byte(0x08); } // movzx ecx, byte [rax+rcx]
+    void WritePage() { Byte(0x88); Byte(0x14); Byte(0x08); }            // mov byte [rax+rcx], dl
+
+    void CallMember(const void* function)
+    {
+#if defined(_WIN32)
+        Byte(0x48); Byte(0x89); Byte(0xD9); // mov rcx, rbx
+#else
+        Byte(0x48); Byte(0x89); Byte(0xDF); // mov rdi, rbx
+#endif
+        Byte(0x48); Byte(0xB8); Imm64(reinterpret_cast<uint64_t>(function)); // mov rax, imm64
+        Byte(0xFF); Byte(0xD0);             // call rax
+    }
+
+    // jumps with a rel32 that gets filled in later, returns where the rel32 is
+    size_t Jne() { Byte(0x0F); Byte(0x85); Imm32(0); return code.size() - 4; }
+    size_t Jle() { Byte(0x0F); Byte(0x8E); Imm32(0); return code.size() - 4; }
+    size_t Jmp() { Byte(0xE9); Imm32(0); return code.size() - 4; }
+
+    void Patch(size_t at, size_t target)
+    {
+        uint32_t rel = static_cast<uint32_t>(static_cast<int32_t>(target) - static_cast<int32_t>(at + 4));
+        for (int i = 0; i < 4; i++) {
+            code[at + i] = (rel >> (i * 8)) & 0xFF;
+        }
+    }
+};
+
+// A non virtual member function pointer starts with the code address on both MSVC and the Itanium ABI,
+// CPU has no bases or virtual functions so that's all there is to it.
+template<typename Func>
+static const void* HandlerAddress(Func f)
+{
+    static_assert(sizeof(Func) >= sizeof(void*), "unexpected member function pointer layout");
+    const void* address;
+    std::memcpy(&address, &f, sizeof(address));
+    return address;
+}
+
+// opcodes that go through the I/O page no matter what the registers hold
+static bool TouchesIO(uint8_t op)
+{
+    return op == 0xE0 || op == 0xF0 || op == 0xE2 || op == 0xF2 || op == 0xD3 || op == 0xDB;
+}
+
+// what CompileBlock writes out itself instead of calling the handler
+enum NativeOp { NATIVE_NONE, NATIVE_INLINE, NATIVE_READ_HL, NATIVE_WRITE_HL };
+
+static NativeOp Classify(uint8_t code)
+{
+    bool hlSrc = (code & 7) == 6;
+    bool hlDst = ((code >> 3) & 7) == 6;
+
+    if (code == 0x00) {
+        return NATIVE_INLINE; // NOP
+    }
+    if (code >= 0x40 && code < 0x80 && code != 0x76) {
+        return hlSrc ? NATIVE_READ_HL : hlDst ? NATIVE_WRITE_HL : NATIVE_INLINE; // LD r, r'
+    }
+    if (code < 0x40 && (code & 7) == 6) {
+        return hlDst ? NATIVE_WRITE_HL : NATIVE_INLINE; // LD r, d8
+    }
+
+#if !GB_LAZY_FLAGS
+    // these write F straight away, with lazy flags they're left to the handlers
+    if (code >= 0x80 && code < 0xC0) {
+        return hlSrc ? NATIVE_READ_HL : NATIVE_INLINE; // ALU A, r
+    }
+    if ((code & 0xC7) == 0xC6) {
+        return NATIVE_INLINE; // ALU A, d8
+    }
+    if (code < 0x40 && ((code & 7) == 4 || (code & 7) == 5) && !hlDst) {
+        return NATIVE_INLINE; // INC r / DEC r
+    }
+    if (code == 0x2F || code == 0x37 || code == 0x3F) {
+        return NATIVE_INLINE; // CPL, SCF, CCF
+    }
+#endif
+
+    return NATIVE_NONE;
+}
+
+bool CPU::CanCompile(const DecodedBlock& block) const
+{
+    if (block.end > 0x8000) {
+        return false; // not ROM
+    }
+
+    for (const DecodedOp& op : block.ops) {
+        if (!op.prefixed && TouchesIO(op.opcode)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CPU::ResetJit()
+{
+    // counted again from nothing, so the blocks that are still hot come back once the arena has room
+    for (auto& entry : blockCache) {
+        entry.second.native = nullptr;
+        entry.second.runs = 0;
+    }
+
+    if (jitArena) {
+        jitArena->Reset();
+    }
+}
+
+void CPU::CompileBlock(DecodedBlock& block)
+{
+    if (!jitArena) {
+        jitArena.reset(new JitArena(JIT_ARENA_SIZE));
+    }
+
+    if (!jitArena->Available()) {
+        return;
+    }
+
+    const uint8_t* self = reinterpret_cast<const uint8_t*>(this);
+    const int32_t pcOffset = static_cast<int32_t>(reinterpret_cast<const uint8_t*>(&pc) - self);
+    const int32_t cyclesOffset = static_cast<int32_t>(reinterpret_cast<const uint8_t*>(&cycles) - self);
+    const int32_t opcodeOffset = static_cast<int32_t>(reinterpret_cast<const uint8_t*>(&opcode) - self);
+    const int32_t operandOffset = static_cast<int32_t>(reinterpret_cast<const uint8_t*>(&operand) - self);
+    const int32_t generationOffset = static_cast<int32_t>(reinterpret_cast<const uint8_t*>(&blockGeneration) - self);
+    const int32_t registersOffset = static_cast<int32_t>(reinterpret_cast<const uint8_t*>(registers) - self);
+
+    struct ExitStub
+    {
+        bool storePc;   // the pc and operand in memory are stale, the last op was done inline
+        uint16_t pc;
+        uint32_t cycles; // cycles used since `cycles` was last brought up to date
+        uint8_t opcode;
+        uint16_t operand;
+    };
+
+    const int32_t flagsOffset = static_cast<int32_t>(reinterpret_cast<const uint8_t*>(&flags) - self);
+    const int32_t readPagesOffset = static_cast<int32_t>(reinterpret_cast<const uint8_t*>(readPages) - self);
+    const int32_t writePagesOffset = static_cast<int32_t>(reinterpret_cast<const uint8_t*>(writePages) - self);
+
+    X64Emitter e;
+    e.code.reserve(block.ops.size() * 48 + 64);
+    std::vector<ExitStub> stubs(block.ops.size());
+    std::vector<std::pair<size_t, size_t>> exits; // where the rel32 of a jump to a stub is, which stub. in stub order
+    exits.reserve(block.ops.size() * 2);
+
+    e.Prologue();
+    e.LoadR13(generationOffset);
+
+    uint16_t at = block.start;
+    uint32_t used = 0;
+    uint32_t synced = 0; // how much of `used` is already in `cycles`
+    bool pcInMemory = true; // pc in memory matches `at`
+
+    // the handler, with the pc, operand and cycles where it expects them, then out through the stub if it
+    // branched or wrote over cached code
+    auto callHandler = [&](const DecodedOp& op, size_t stub) {
+        if (op.prefixed) {
+            e.Store16(pcOffset, static_cast<uint16_t>(at + 1)); // Cycle() steps onto the CB opcode first
+        }
+        else if (!pcInMemory) {
+            e.Store16(pcOffset, at);
+        }
+        e.Store16(operandOffset, op.operand);
+
+        // handlers that start something (OAM DMA, the timer) go by `cycles`, which has to be the start of
+        // this instruction like it is in the interpreter
+        uint32_t before = used - op.cycles;
+        if (before != synced) {
+            e.Add64(cyclesOffset, before - synced);
+            synced = before;
+        }
+
+        e.CallMember(HandlerAddress(op.handler));
+
+        if (op.prefixed) {
+            e.Add16(pcOffset, 1);
+        }
+
+        e.Cmp16(pcOffset, static_cast<uint16_t>(at + op.length));
+        exits.emplace_back(e.Jne(), stub); // branch taken, or the handler moved the pc some other way
+        e.CmpR13(generationOffset);
+        exits.emplace_back(e.Jne(), stub); // the handler wrote over cached code
+    };
+
+    for (size_t i = 0; i < block.ops.size(); i++) {
+        const DecodedOp& op = block.ops[i];
+        uint16_t next = static_cast<uint16_t>(at + op.length);
+        used += op.cycles;
+
+        ExitStub& stub = stubs[i];
+        stub.pc = next;
+        stub.opcode = op.opcode;
+        stub.operand = op.operand;
+
+        uint8_t code = op.opcode;
+        uint8_t imm = op.operand & 0xFF;
+        uint8_t dst = RegFromCode((code >> 3) & 7);
+        uint8_t src = RegFromCode(code & 7);
+
+        NativeOp native = op.prefixed ? NATIVE_NONE : Classify(code);
+
+        if (native == NATIVE_NONE) {
+            callHandler(op, i);
+            pcInMemory = true;
+            stub.storePc = false;
+        }
+        else {
+            // (HL) goes through the page tables here the same way ReadByte / WriteByte do, a null page is the
+            // handler's to deal with. Either way round the cycles have to be up to date for it
+            size_t slowPath = 0;
+            bool memory = native == NATIVE_READ_HL || native == NATIVE_WRITE_HL;
+            if (memory) {
+                uint32_t before = used - op.cycles;
+                if (before != synced) {
+                    e.Add64(cyclesOffset, before - synced);
+                    synced = before;
+                }
+            }
+
+            if (native == NATIVE_READ_HL) {
+                slowPath = e.LoadPage(readPagesOffset, registersOffset + H);
+                e.Load8(X64Emitter::ECX, registersOffset + L);
+                e.ReadPage(); // ecx = the byte at (HL)
+            }
+            else if (native == NATIVE_WRITE_HL) {
+                if (code == 0x36) {
+                    e.MoveImm(X64Emitter::EDX, imm);
+                }
+                else {
+                    e.Load8(X64Emitter::EDX, registersOffset + src);
+                }
+                slowPath = e.LoadPage(writePagesOffset, registersOffset + H);
+                e.Load8(X64Emitter::ECX, registersOffset + L);
+                e.WritePage();
+            }
+            else if (code >= 0x80 && code < 0xC0) {
+                e.Load8(X64Emitter::ECX, registersOffset + src);
+            }
+            else if ((code & 0xC7) == 0xC6) {
+                e.MoveImm(X64Emitter::ECX, imm);
+            }
+
+            if (code >= 0x40 && code < 0x80 && native != NATIVE_WRITE_HL) {
+                // LD r, r' / LD r, (HL)
+                if (native == NATIVE_READ_HL) {
+                    e.Store8Reg(registersOffset + dst, X64Emitter::ECX);
+                }
+                else if (dst != src) {
+                    e.Move8(registersOffset + dst, registersOffset + src);
+                }
+            }
+            else if (code < 0x40 && (code & 0xC7) == 0x06 && native != NATIVE_WRITE_HL) {
+                e.Store8(registersOffset + dst, imm); // LD r, d8
+            }
+            else if (code >= 0x80) {
+                // ALU A, x with x in ecx. everything but AND/XOR/OR is one load from the same tables the
+                // interpreter uses, result in ah and flags in al
+                uint8_t alu = (code >> 3) & 7;
+                if (alu == ALU_AND || alu == ALU_XOR || alu == ALU_OR) {
+                    static const uint8_t logic[3] = { 0x20, 0x30, 0x08 };
+                    e.Load8(X64Emitter::EAX, registersOffset + A);
+                    e.AluAlCl(logic[alu - ALU_AND]);
+                    e.Store8Reg(registersOffset + A, X64Emitter::EAX);
+                    e.ZeroFlag(alu == ALU_AND ? FLAG_H : 0);
+                    e.Store8Reg(registersOffset + F, X64Emitter::ECX);
+                    e.Store8Reg(flagsOffset, X64Emitter::ECX);
+                }
+                else {
+                    bool add = alu == ALU_ADD || alu == ALU_ADC;
+                    e.Load8(X64Emitter::EAX, registersOffset + A);
+                    e.ShlImm(X64Emitter::EAX, 8);
+                    e.OrReg(X64Emitter::EAX, X64Emitter::ECX);
+                    if (alu == ALU_ADC || alu == ALU_SBC) {
+                        e.Load8(X64Emitter::EDX, flagsOffset); // CarryFlag()
+                        e.AndImm(X64Emitter::EDX, FLAG_C);
+                        e.ShlImm(X64Emitter::EDX, 12); // FLAG_C << 12 picks the carry half of the table
+                        e.OrReg(X64Emitter::EAX, X64Emitter::EDX);
+                    }
+                    e.TableLookup(add ? &aluTables.add[0][0][0] : &aluTables.sub[0][0][0]);
+                    if (alu != ALU_CP) {
+                        e.Store8Reg(registersOffset + A, X64Emitter::AH);
+                    }
+                    e.Store8Reg(registersOffset + F, X64Emitter::EAX);
+                    e.Store8Reg(flagsOffset, X64Emitter::EAX);
+                }
+            }
+            else if ((code & 0xC7) == 0x04 || (code & 0xC7) == 0x05) {
+                // INC r / DEC r, C stays what it was
+                e.Load8(X64Emitter::EAX, registersOffset + dst);
+                e.TableLookup((code & 1) ? aluTables.dec : aluTables.inc);
+                e.Store8Reg(registersOffset + dst, X64Emitter::AH);
+                e.Load8(X64Emitter::ECX, flagsOffset);
+                e.AndImm(X64Emitter::ECX, FLAG_C);
+                e.OrReg(X64Emitter::EAX, X64Emitter::ECX);
+                e.Store8Reg(registersOffset + F, X64Emitter::EAX);
+                e.Store8Reg(flagsOffset, X64Emitter::EAX);
+            }
+            else if (code == 0x2F || code == 0x37 || code == 0x3F) {
+                e.Load8(X64Emitter::EAX, registersOffset + F);
+                if (code == 0x2F) {
+                    e.Not8(registersOffset + A);                      // CPL
+                    e.AluAlImm(0x0C, FLAG_N | FLAG_H);
+                }
+                else if (code == 0x37) {
+                    e.AluAlImm(0x24, FLAG_Z);                         // SCF
+                    e.AluAlImm(0x0C, FLAG_C);
+                }
+                else {
+                    e.AluAlImm(0x24, FLAG_Z | FLAG_C);                // CCF
+                    e.AluAlImm(0x34, FLAG_C);
+                }
+                e.Store8Reg(registersOffset + F, X64Emitter::EAX);
+                e.Store8Reg(flagsOffset, X64Emitter::EAX);
+            }
+
+            if (memory) {
+                size_t done = e.Jmp();
+                e.Patch(slowPath, e.code.size());
+                callHandler(op, i); // leaves the pc at `next` like the inline path does
+                e.Patch(done, e.code.size());
+            }
+
+            pcInMemory = false;
+            stub.storePc = true;
+        }
+
+        stub.cycles = used - synced;
+
+        if (i + 1 < block.ops.size()) {
+            e.CmpR12(used);
+            exits.emplace_back(e.Jle(), i); // out of cycles
+        }
+        else {
+            exits.emplace_back(e.Jmp(), i);
+        }
+
+        at = next;
+    }
+
+    // the stubs only load what they leave behind into registers and go to one of two shared exits, they're
+    // most of the code so that keeps blocks small. rax = pc | opcode << 16 | operand << 32 or just the opcode,
+    // rcx = cycles
+    std::vector<size_t> toExitInline;
+    std::vector<size_t> toExitHandler;
+    size_t nextExit = 0;
+    for (size_t i = 0; i < stubs.size(); i++) {
+        const ExitStub& stub = stubs[i];
+        for (; nextExit < exits.size() && exits[nextExit].second == i; nextExit++) {
+            e.Patch(exits[nextExit].first, e.code.size());
+        }
+
+        if (stub.storePc) {
+            e.MoveRaxImm64(stub.pc | static_cast<uint64_t>(stub.opcode) << 16 | static_cast<uint64_t>(stub.operand) << 32);
+        }
+        else {
+            e.MoveImm(X64Emitter::EAX, stub.opcode);
+        }
+        e.MoveImm(X64Emitter::ECX, stub.cycles);
+        (stub.storePc ? toExitInline : toExitHandler).push_back(e.Jmp());
+    }
+
+    // the last op was done inline, the pc and operand in memory are stale
+    for (size_t jump : toExitInline) {
+        e.Patch(jump, e.code.size());
+    }
+    if (!toExitInline.empty()) {
+        e.Store16Ax(pcOffset);
+        e.ShrRax16();
+        e.Store16Ax(opcodeOffset);
+        e.ShrRax16();
+        e.Store16Ax(operandOffset);
+        e.Add64Rcx(cyclesOffset);
+        e.Epilogue();
+    }
+
+    // the last op was a handler, which left the pc and operand where they should be
+    for (size_t jump : toExitHandler) {
+        e.Patch(jump, e.code.size());
+    }
+    if (!toExitHandler.empty()) {
+        e.Store16Ax(opcodeOffset);
+        e.Add64Rcx(cyclesOffset);
+        e.Epilogue();
+    }
+
+    void* native = jitArena->Place(e.code.data(), e.code.size());
+    if (!native) {
+        ResetJit(); // full, start over
+        native = jitArena->Place(e.code.data(), e.code.size());
+    }
+
+    if (native) {
+        block.native = reinterpret_cast<JitBlock>(native);
+        blockStats.compiled++;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+
+Executable memory for the x86-64 block compiler (GB_CORE_JIT, Jit.cpp).
+
+One big region is mapped up front and blocks are appended to it. Nothing is freed on its own, when it fills
+up the CPU drops every compiled block and starts again from the beginning.
+
+Pages are never writable and executable at once (W^X). The region is shared memory mapped twice, a read/write
+view that Place copies blocks into and a read/execute view the blocks run from, so nothing ever has to change
+its protection. The generated code only jumps within itself and calls absolute addresses, so it doesn't mind
+being written at one address and run at another.
+
+*/
+
+class JitArena
+{
+public:
+    explicit JitArena(size_t size);
+    ~JitArena();
+
+    JitArena(const JitArena&) = delete;
+    JitArena& operator=(const JitArena&) = delete;
+
+    bool Available() const { return executable != nullptr; } // false if the OS wouldn't give us executable memory
+    void* Place(const uint8_t* code, size_t length); // copies code in, returns where it runs from, null when full
+    void Reset() { used = 0; }
+
+private:
+    uint8_t* writable = nullptr;   // the view blocks are copied into
+    uint8_t* executable = nullptr; // the same memory, the view they run from
+    size_t size = 0;
+    size_t used = 0;
+
+    void Release();
+};
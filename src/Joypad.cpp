@@ -0,0 +1,56 @@
+#include "CPU.h"
+
+Joypad::Joypad(CPU& cpu)
+    :cpu(cpu)
+{
+}
+
+void Joypad::Reset()
+{
+    buttons = 0;
+    cpu.StoreByte(P1, 0xFF);
+}
+
+void Joypad::Write(uint8_t value)
+{
+    // only the select bits can be written
+    cpu.StoreByte(P1, (cpu.Mem(P1) & 0xCF) | (value & 0x30));
+    Update();
+}
+
+void Joypad::SetButtons(uint8_t pressed)
+{
+    uint8_t before = cpu.Mem(P1);
+    buttons = pressed;
+    Update();
+
+    // a selected line going low
+    if (before & ~cpu.Mem(P1) & 0x0F) {
+        cpu.RequestInterrupt(4); // Joypad
+    }
+}
+
+void Joypad::Update()
+{
+    uint8_t select = cpu.Mem(P1) & 0x30;
+    uint8_t lines = 0;
+
+    if (!(select & 0x10)) {
+        lines |= buttons & 0x0F; // directions
+    }
+    if (!(select & 0x20)) {
+        lines |= buttons >> 4; // A, B, Select, Start
+    }
+
+    cpu.StoreByte(P1, 0xC0 | select | (~lines & 0x0F));
+}
+
+void Joypad::SaveState(StateWriter& state) const
+{
+    state.Value(buttons); // P1 itself is in the I/O registers
+}
+
+bool Joypad::LoadState(StateReader& state)
+{
+    return state.Value(buttons);
+}
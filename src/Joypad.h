@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+class CPU;
+class StateWriter;
+class StateReader;
+
+/*
+
+Joypad (P1, 0xFF00).
+
+The game picks the direction keys (bit 4 low) and/or the buttons (bit 5 low) and reads them back in bits 0 - 3,
+0 meaning pressed. Whatever feeds input in calls SetButtons with the whole pad at once, P1 is worked out then
+and kept in memory like the other registers, and going from released to pressed on a selected line requests the
+joypad interrupt.
+
+*/
+
+class Joypad
+{
+public:
+    static const uint16_t P1 = 0xFF00;
+
+    // bits for SetButtons
+    enum Button : uint8_t
+    {
+        RIGHT = 0x01, LEFT = 0x02, UP = 0x04, DOWN = 0x08,
+        BUTTON_A = 0x10, BUTTON_B = 0x20, SELECT = 0x40, START = 0x80
+    };
+
+    explicit Joypad(CPU& cpu);
+
+    void Reset();
+    void Write(uint8_t value);
+    void SetButtons(uint8_t pressed);
+    uint8_t Buttons() const { return buttons; }
+
+    void SaveState(StateWriter& state) const;
+    bool LoadState(StateReader& state);
+
+private:
+    CPU& cpu;
+    uint8_t buttons = 0; // pressed, Button bits
+
+    void Update(); // P1 from the select bits and the buttons
+};
@@ -0,0 +1,221 @@
+#include "CPU.h"
+#include "Movie.h"
+
+#include <sstream>
+#include <cctype>
+
+static const char MOVIE_MAGIC[4] = { 'G', 'B', 'M', 'V' };
+static const uint32_t MOVIE_VERSION = 1;
+
+struct MovieFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t seed;
+    uint64_t romSize;
+    uint32_t romHash;
+    uint32_t pad;
+    uint64_t inputCount;
+    uint64_t hashCount;
+};
+
+static const struct { const char* name; uint8_t bit; } BUTTON_NAMES[] = {
+    { "right", Joypad::RIGHT }, { "left", Joypad::LEFT }, { "up", Joypad::UP }, { "down", Joypad::DOWN },
+    { "a", Joypad::BUTTON_A }, { "b", Joypad::BUTTON_B }, { "select", Joypad::SELECT }, { "start", Joypad::START }
+};
+
+bool ReadInputScript(const char* path, std::vector<Movie::Input>& inputs)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Error: Could not open input script " << path << std::endl;
+        return false;
+    }
+
+    inputs.clear();
+
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+        std::istringstream words(line);
+
+        std::string first;
+        if (!(words >> first) || first[0] == '#') {
+            continue;
+        }
+
+        Movie::Input input{};
+        std::istringstream frame(first);
+        if (!(frame >> input.frame) || !frame.eof()) {
+            std::cerr << "Error: " << path << ":" << number << ": " << first << " is not a frame number" << std::endl;
+            return false;
+        }
+
+        std::string name;
+        while (words >> name) {
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (name == "none") {
+                continue;
+            }
+
+            uint8_t bit = 0;
+            for (const auto& button : BUTTON_NAMES) {
+                if (name == button.name) {
+                    bit = button.bit;
+                }
+            }
+            if (!bit) {
+                std::cerr << "Error: " << path << ":" << number << ": unknown button " << name << std::endl;
+                return false;
+            }
+            input.buttons |= bit;
+        }
+
+        inputs.push_back(input);
+    }
+
+    // a later line for the same frame wins
+    std::stable_sort(inputs.begin(), inputs.end(), [](const Movie::Input& a, const Movie::Input& b) { return a.frame < b.frame; });
+    return true;
+}
+
+uint64_t StateHash(const CPU& cpu, std::vector<uint8_t>& scratch)
+{
+    cpu.SaveState(scratch);
+
+    // 8 bytes at a time, this runs every frame while replaying
+    uint64_t hash = 1469598103934665603ull ^ scratch.size();
+    size_t i = 0;
+    for (; i + 8 <= scratch.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, &scratch[i], 8);
+        hash = (hash ^ word) * 0x100000001B3ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < scratch.size(); i++) {
+        hash = (hash ^ scratch[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+void Movie::Start(const CPU& cpu)
+{
+    seed = cpu.GetSeed();
+    romSize = cpu.cart.Loaded() ? cpu.cart.Image()->Size() : 0;
+    romHash = cpu.cart.HeaderHash();
+    inputs.clear();
+    hashes.clear();
+}
+
+void Movie::Record(const CPU& cpu)
+{
+    uint8_t buttons = cpu.joypad.Buttons();
+    uint8_t last = inputs.empty() ? 0 : inputs.back().buttons;
+
+    if (buttons != last) {
+        inputs.push_back({ cpu.frameCount, buttons });
+    }
+}
+
+void Movie::RecordHash(const CPU& cpu)
+{
+    hashes.push_back(StateHash(cpu, scratch));
+}
+
+bool Movie::Matches(const CPU& cpu) const
+{
+    return romSize == (cpu.cart.Loaded() ? cpu.cart.Image()->Size() : 0) && romHash == cpu.cart.HeaderHash();
+}
+
+bool Movie::Save(const char* path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Could not open movie file " << path << std::endl;
+        return false;
+    }
+
+    MovieFileHeader header{};
+    std::memcpy(header.magic, MOVIE_MAGIC, sizeof(header.magic));
+    header.version = MOVIE_VERSION;
+    header.seed = seed;
+    header.romSize = romSize;
+    header.romHash = romHash;
+    header.inputCount = inputs.size();
+    header.hashCount = hashes.size();
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const Input& input : inputs) {
+        file.write(reinterpret_cast<const char*>(&input.frame), sizeof(input.frame));
+        file.write(reinterpret_cast<const char*>(&input.buttons), sizeof(input.buttons));
+    }
+    file.write(reinterpret_cast<const char*>(hashes.data()), hashes.size() * sizeof(uint64_t));
+
+    return static_cast<bool>(file);
+}
+
+bool Movie::Load(const char* path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Could not open movie file " << path << std::endl;
+        return false;
+    }
+
+    MovieFileHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (!file || !std::equal(MOVIE_MAGIC, MOVIE_MAGIC + 4, header.magic) || header.version != MOVIE_VERSION) {
+        std::cerr << "Error: " << path << " is not a movie this build can read" << std::endl;
+        return false;
+    }
+
+    seed = header.seed;
+    romSize = header.romSize;
+    romHash = header.romHash;
+
+    inputs.clear();
+    for (uint64_t i = 0; i < header.inputCount; i++) {
+        Input input{};
+        file.read(reinterpret_cast<char*>(&input.frame), sizeof(input.frame));
+        file.read(reinterpret_cast<char*>(&input.buttons), sizeof(input.buttons));
+        if (!file) {
+            break;
+        }
+        inputs.push_back(input);
+    }
+
+    hashes.clear();
+    uint64_t hash;
+    for (uint64_t i = 0; i < header.hashCount && file.read(reinterpret_cast<char*>(&hash), sizeof(hash)); i++) {
+        hashes.push_back(hash);
+    }
+
+    if (inputs.size() != header.inputCount || hashes.size() != header.hashCount) {
+        std::cerr << "Error: " << path << " is cut short" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t PlayMovie(CPU& cpu, const Movie& movie)
+{
+    std::vector<uint8_t> scratch;
+    size_t next = 0;
+
+    for (uint64_t frame = 0; frame < movie.Frames(); frame++) {
+        // the pad as it was when this frame started
+        while (next < movie.inputs.size() && movie.inputs[next].frame <= cpu.frameCount) {
+            cpu.joypad.SetButtons(movie.inputs[next].buttons);
+            next++;
+        }
+
+        cpu.RunFrame();
+
+        if (StateHash(cpu, scratch) != movie.hashes[frame]) {
+            return frame;
+        }
+    }
+
+    return movie.Frames();
+}
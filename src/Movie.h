@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class CPU;
+
+/*
+
+Input movies.
+
+A movie is the seed, which ROM it's for, and the pad at the start of every frame where it changed, keyed by frame
+number (CPU::frameCount). Nothing else the emulator does depends on anything but the ROM and its own cycle count,
+so the same inputs at the same frames give the same run bit for bit. Recording also keeps a hash of the whole
+state after every frame, and replaying checks against those and says which frame it first went different at.
+
+Movies start from power on, straight after LoadROM. Replaying is headless and runs as fast as the core goes:
+
+    GameboyEmulator rom --record run.gbm --input pad.txt [--frames n] [--seed n]
+    GameboyEmulator rom --replay run.gbm
+
+There's no window to press keys in, so what gets recorded comes from an input script. Each line is a frame number
+and the buttons held from that frame on, the whole pad at once, "none" to let go of everything:
+
+    # frame buttons
+    60 start
+    64 none
+    120 right a
+    180 none
+
+*/
+
+class Movie
+{
+public:
+    struct Input
+    {
+        uint64_t frame;
+        uint8_t buttons; // Joypad::Button bits
+    };
+
+    uint64_t seed = 0;
+    uint64_t romSize = 0;
+    uint32_t romHash = 0;
+    std::vector<Input> inputs;    // only the frames where the pad changed, in order
+    std::vector<uint64_t> hashes; // hashes[n] is the state after frame n
+
+    void Start(const CPU& cpu);      // empties it, takes the seed and the ROM from the cpu
+    void Record(const CPU& cpu);     // before each frame, once the pad is set for it
+    void RecordHash(const CPU& cpu); // after each frame
+    uint64_t Frames() const { return hashes.size(); }
+
+    bool Matches(const CPU& cpu) const; // same ROM
+    bool Save(const char* path) const;
+    bool Load(const char* path);
+
+private:
+    std::vector<uint8_t> scratch;
+};
+
+// an input script as above, sorted by frame, in the same form a movie keeps its inputs
+bool ReadInputScript(const char* path, std::vector<Movie::Input>& inputs);
+
+// everything a savestate has, hashed
+uint64_t StateHash(const CPU& cpu, std::vector<uint8_t>& scratch);
+
+// plays the movie from where the cpu is now (it has to be straight after LoadROM, with the movie's seed).
+// returns the first frame whose hash is different, or Frames() if they all matched
+uint64_t PlayMovie(CPU& cpu, const Movie& movie);
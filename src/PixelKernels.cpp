@@ -0,0 +1,223 @@
+#include "PixelKernels.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PIXEL_X64 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PIXEL_TARGET(isa) // MSVC lets any function use any intrinsic
+#else
+#define PIXEL_TARGET(isa) __attribute__((target(isa))) // the rest of the file still builds for plain x86-64
+#endif
+#else
+#define PIXEL_X64 0
+#endif
+
+// byte k gets bit 7 - k of `bits`, as 0 or 1. the multiply puts a copy of the byte in every byte, the mask
+// keeps a different bit in each, and adding 0x7F carries whichever bit is left up into bit 7
+static uint64_t SpreadBits(uint8_t bits)
+{
+    uint64_t spread = (bits * 0x0101010101010101ull) & 0x0102040810204080ull;
+    return ((spread + 0x7F7F7F7F7F7F7F7Full) >> 7) & 0x0101010101010101ull;
+}
+
+static void DecodeTileScalar(const uint8_t* planes, uint8_t* colors)
+{
+    for (int row = 0; row < 8; row++) {
+        uint64_t pixels = SpreadBits(planes[row * 2]) | (SpreadBits(planes[row * 2 + 1]) << 1);
+        std::memcpy(colors + row * 8, &pixels, 8); // little endian, the leftmost pixel is the lowest byte
+    }
+}
+
+static void ApplyPaletteScalar(const uint8_t* colors, uint8_t* shades, int count, uint8_t palette)
+{
+    const uint8_t table[4] = {
+        static_cast<uint8_t>(palette & 3), static_cast<uint8_t>((palette >> 2) & 3),
+        static_cast<uint8_t>((palette >> 4) & 3), static_cast<uint8_t>(palette >> 6)
+    };
+    for (int i = 0; i < count; i++) {
+        shades[i] = table[colors[i]];
+    }
+}
+
+static void BlendSpriteScalar(const uint8_t* sprite, const uint8_t* bg, uint8_t* taken, uint8_t* shades,
+    uint8_t palette, bool behindBg)
+{
+    for (int i = 0; i < 8; i++) {
+        uint8_t color = sprite[i];
+        if (color == 0 || taken[i]) {
+            continue; // transparent, or a sprite with priority is already there
+        }
+        taken[i] = 0xFF;
+
+        if (behindBg && bg[i] != 0) {
+            continue; // behind BG colors 1 - 3
+        }
+        shades[i] = (palette >> (color * 2)) & 3;
+    }
+}
+
+#if PIXEL_X64
+
+// the low plane byte of `row` copied over 8 bytes, the high one is the byte after
+static const long long BROADCAST = 0x0101010101010101ll;
+
+PIXEL_TARGET("ssse3")
+static void DecodeTileSSSE3(const uint8_t* planes, uint8_t* colors)
+{
+    const __m128i rows = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes));
+    const __m128i bits = _mm_set1_epi64x(0x0102040810204080ll); // bit 7 for the first byte, down to bit 0
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi8(2);
+
+    for (int row = 0; row < 8; row += 2) {
+        __m128i index = _mm_set_epi64x(BROADCAST * (row * 2 + 2), BROADCAST * (row * 2));
+        __m128i low = _mm_shuffle_epi8(rows, index);
+        __m128i high = _mm_shuffle_epi8(rows, _mm_add_epi8(index, one));
+
+        low = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(low, bits), bits), one);
+        high = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(high, bits), bits), two);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(colors + row * 8), _mm_or_si128(low, high));
+    }
+}
+
+PIXEL_TARGET("ssse3")
+static __m128i PaletteTable(uint8_t palette)
+{
+    return _mm_setr_epi8(palette & 3, (palette >> 2) & 3, (palette >> 4) & 3, palette >> 6,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+}
+
+PIXEL_TARGET("ssse3")
+static void ApplyPaletteSSSE3(const uint8_t* colors, uint8_t* shades, int count, uint8_t palette)
+{
+    const __m128i table = PaletteTable(palette);
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i color = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colors + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(shades + i), _mm_shuffle_epi8(table, color));
+    }
+    ApplyPaletteScalar(colors + i, shades + i, count - i, palette);
+}
+
+PIXEL_TARGET("ssse3")
+static void BlendSpriteSSSE3(const uint8_t* sprite, const uint8_t* bg, uint8_t* taken, uint8_t* shades,
+    uint8_t palette, bool behindBg)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i color = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(sprite));
+    __m128i before = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(taken));
+    __m128i transparent = _mm_cmpeq_epi8(color, zero);
+
+    // opaque pixels nobody has yet are this sprite's, whether they end up showing or not
+    __m128i mine = _mm_andnot_si128(transparent, _mm_cmpeq_epi8(before, zero));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(taken), _mm_or_si128(before, mine));
+
+    if (behindBg) {
+        __m128i background = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(bg));
+        mine = _mm_and_si128(mine, _mm_cmpeq_epi8(background, zero));
+    }
+
+    __m128i shade = _mm_shuffle_epi8(PaletteTable(palette), color);
+    __m128i old = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(shades));
+    __m128i blended = _mm_or_si128(_mm_and_si128(mine, shade), _mm_andnot_si128(mine, old));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(shades), blended);
+}
+
+PIXEL_TARGET("avx2")
+static void DecodeTileAVX2(const uint8_t* planes, uint8_t* colors)
+{
+    // the shuffle stays inside each 128 bit half, so both halves get all 16 bytes
+    const __m256i rows = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(planes)));
+    const __m256i bits = _mm256_set1_epi64x(0x0102040810204080ll);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi8(2);
+
+    for (int row = 0; row < 8; row += 4) {
+        __m256i index = _mm256_set_epi64x(BROADCAST * (row * 2 + 6), BROADCAST * (row * 2 + 4),
+            BROADCAST * (row * 2 + 2), BROADCAST * (row * 2));
+        __m256i low = _mm256_shuffle_epi8(rows, index);
+        __m256i high = _mm256_shuffle_epi8(rows, _mm256_add_epi8(index, one));
+
+        low = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(low, bits), bits), one);
+        high = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(high, bits), bits), two);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + row * 8), _mm256_or_si256(low, high));
+    }
+}
+
+PIXEL_TARGET("avx2")
+static void ApplyPaletteAVX2(const uint8_t* colors, uint8_t* shades, int count, uint8_t palette)
+{
+    const __m256i table = _mm256_broadcastsi128_si256(PaletteTable(palette));
+
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i color = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colors + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(shades + i), _mm256_shuffle_epi8(table, color));
+    }
+
+    // GCC tail calls out of here without clearing the upper halves, and the next SSE code pays for that
+    _mm256_zeroupper();
+    ApplyPaletteScalar(colors + i, shades + i, count - i, palette);
+}
+
+static PixelIsa DetectIsa()
+{
+    bool ssse3;
+    bool avx2;
+
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int leaves = info[0];
+
+    __cpuid(info, 1);
+    ssse3 = (info[2] >> 9) & 1;
+    bool osSavesYmm = ((info[2] >> 27) & 1) && (_xgetbv(0) & 6) == 6; // OSXSAVE, and XMM + YMM state enabled
+
+    avx2 = false;
+    if (osSavesYmm && leaves >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] >> 5) & 1;
+    }
+#else
+    __builtin_cpu_init();
+    ssse3 = __builtin_cpu_supports("ssse3");
+    avx2 = __builtin_cpu_supports("avx2"); // only if the OS saves the YMM registers too
+#endif
+
+    return avx2 ? PIXEL_AVX2 : ssse3 ? PIXEL_SSSE3 : PIXEL_SCALAR;
+}
+
+#else
+
+static PixelIsa DetectIsa()
+{
+    return PIXEL_SCALAR;
+}
+
+#endif
+
+// indexed by PixelIsa, only the ones this build has
+static const PixelKernels KERNELS[] = {
+    { PIXEL_SCALAR, "scalar", DecodeTileScalar, ApplyPaletteScalar, BlendSpriteScalar },
+#if PIXEL_X64
+    { PIXEL_SSSE3, "ssse3", DecodeTileSSSE3, ApplyPaletteSSSE3, BlendSpriteSSSE3 },
+    { PIXEL_AVX2, "avx2", DecodeTileAVX2, ApplyPaletteAVX2, BlendSpriteSSSE3 }, // a sprite is only 8 pixels
+#endif
+};
+
+PixelIsa BestPixelIsa()
+{
+    static const PixelIsa best = DetectIsa();
+    return best;
+}
+
+const PixelKernels& GetPixelKernels(PixelIsa isa)
+{
+    return KERNELS[isa < BestPixelIsa() ? isa : BestPixelIsa()];
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+
+Pixel kernels.
+
+The inner loops of the PPU, in a few versions, picked at runtime from what the CPU running it has:
+
+    decodeTile    16 bytes of bit planes to 64 color numbers. 2 rows per SSSE3 shuffle, 4 per AVX2 one,
+                  the scalar version spreads a byte's bits over a 64 bit word with a multiply
+    applyPalette  color numbers to shades, the palette is a 4 entry shuffle table so it's 16 / 32 pixels at a time
+    blendSprite   one sprite's 8 pixels onto the line: transparency, sprites already there, BG priority and the
+                  palette all worked out as masks and blended in one go
+
+Every version gives exactly the same output, Display::UsePixelIsa switches between them to compare.
+
+*/
+
+enum PixelIsa : uint8_t { PIXEL_SCALAR, PIXEL_SSSE3, PIXEL_AVX2 };
+
+struct PixelKernels
+{
+    PixelIsa isa;
+    const char* name;
+
+    void (*decodeTile)(const uint8_t* planes, uint8_t* colors);
+    void (*applyPalette)(const uint8_t* colors, uint8_t* shades, int count, uint8_t palette);
+
+    // `taken` is 0xFF where a sprite with priority already has a pixel, and gets updated. all of them are 8 bytes
+    void (*blendSprite)(const uint8_t* sprite, const uint8_t* bg, uint8_t* taken, uint8_t* shades, uint8_t palette,
+        bool behindBg);
+};
+
+PixelIsa BestPixelIsa(); // the fastest this machine can run, worked out once
+const PixelKernels& GetPixelKernels(PixelIsa isa); // anything past BestPixelIsa() gets that instead
+
+// an 8 pixel row back to front, for X flipped sprites
+inline uint64_t ReverseBytes(uint64_t row)
+{
+    row = ((row >> 8) & 0x00FF00FF00FF00FFull) | ((row & 0x00FF00FF00FF00FFull) << 8);
+    row = ((row >> 16) & 0x0000FFFF0000FFFFull) | ((row & 0x0000FFFF0000FFFFull) << 16);
+    return (row >> 32) | (row << 32);
+}
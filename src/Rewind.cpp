@@ -0,0 +1,238 @@
+#include "CPU.h"
+#include "Rewind.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <emmintrin.h>
+#define REWIND_SSE2 1 // every x86-64 has it
+#else
+#define REWIND_SSE2 0
+#endif
+
+// a run of zeros has to be at least this long to be worth ending a literal for
+static const size_t MIN_ZERO_RUN = 4;
+
+static void XorBytes(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t size)
+{
+    size_t i = 0;
+#if REWIND_SSE2
+    for (; i + 16 <= size; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(x, y));
+    }
+#endif
+    for (; i < size; i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+// how many zeros there are from `at` on
+static size_t ZeroRun(const uint8_t* data, size_t at, size_t size)
+{
+    size_t i = at;
+#if REWIND_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 16 <= size) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero)) != 0xFFFF) {
+            break; // the bytes loop finds where in these 16
+        }
+        i += 16;
+    }
+#endif
+    while (i < size && data[i] == 0) {
+        i++;
+    }
+    return i - at;
+}
+
+static void PutLength(std::vector<uint8_t>& out, size_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static bool GetLength(const uint8_t*& at, const uint8_t* end, size_t& value)
+{
+    value = 0;
+    for (int shift = 0; at < end && shift < 64; shift += 7) {
+        uint8_t byte = *at++;
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// (zeros, literal length, literal) over and over. `data` is the state, or the state XOR its keyframe
+static void Encode(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+    out.clear();
+
+    size_t at = 0;
+    while (at < size) {
+        size_t zeros = ZeroRun(data, at, size);
+        size_t start = at + zeros;
+
+        size_t end = start;
+        while (end < size) {
+            size_t run = ZeroRun(data, end, std::min(size, end + MIN_ZERO_RUN));
+            if (run >= MIN_ZERO_RUN || end + run == size) {
+                break;
+            }
+            end += run + 1;
+        }
+
+        PutLength(out, zeros);
+        PutLength(out, end - start);
+        out.insert(out.end(), data + start, data + end);
+        at = end;
+    }
+}
+
+// `key` is null for a keyframe, zeros in the data mean "same as the keyframe" otherwise
+static bool Decode(const std::vector<uint8_t>& in, const uint8_t* key, uint8_t* out, size_t size)
+{
+    const uint8_t* at = in.data();
+    const uint8_t* end = at + in.size();
+
+    size_t pos = 0;
+    while (at < end) {
+        size_t zeros;
+        size_t literal;
+        if (!GetLength(at, end, zeros) || !GetLength(at, end, literal)
+            || zeros > size - pos || literal > size - pos - zeros || literal > static_cast<size_t>(end - at)) {
+            return false;
+        }
+
+        if (key) {
+            std::memcpy(out + pos, key + pos, zeros);
+            XorBytes(at, key + pos + zeros, out + pos + zeros, literal);
+        }
+        else {
+            std::memset(out + pos, 0, zeros);
+            std::memcpy(out + pos + zeros, at, literal);
+        }
+
+        pos += zeros + literal;
+        at += literal;
+    }
+
+    return pos == size;
+}
+
+RewindBuffer::RewindBuffer(size_t budget, uint32_t keyframeInterval)
+    :budget(budget), keyframeInterval(std::max(1u, keyframeInterval))
+{
+}
+
+void RewindBuffer::Push(const CPU& cpu)
+{
+    cpu.SaveState(state);
+
+    // serial output makes states grow now and then, a delta needs the same size as its keyframe
+    bool key = frames.empty() || sinceKey >= keyframeInterval || state.size() != keyState.size();
+
+    Frame frame;
+    frame.key = key;
+    frame.size = static_cast<uint32_t>(state.size());
+
+    if (key) {
+        Encode(state.data(), state.size(), coded);
+        keyState = state;
+        sinceKey = 0;
+    }
+    else {
+        XorBytes(state.data(), keyState.data(), state.data(), state.size());
+        Encode(state.data(), state.size(), coded);
+    }
+
+    frame.data.assign(coded.begin(), coded.end()); // exactly as big as it needs to be, `coded` keeps the slack
+    stored += frame.data.size();
+    frames.push_back(std::move(frame));
+    sinceKey++;
+
+    Trim();
+}
+
+bool RewindBuffer::StepBack(CPU& cpu)
+{
+    if (frames.size() < 2) {
+        return false; // the newest frame is where the cpu already is
+    }
+
+    bool droppedKey = frames.back().key;
+    stored -= frames.back().data.size();
+    frames.pop_back();
+
+    if (droppedKey) {
+        // back into the group before, its keyframe is the new reference
+        size_t index = frames.size() - 1;
+        while (!frames[index].key) {
+            index--;
+        }
+
+        const Frame& keyFrame = frames[index];
+        keyState.resize(keyFrame.size);
+        if (!Decode(keyFrame.data, nullptr, keyState.data(), keyState.size())) {
+            return false;
+        }
+        sinceKey = static_cast<uint32_t>(frames.size() - index);
+    }
+    else {
+        sinceKey--;
+    }
+
+    const Frame& frame = frames.back();
+    if (frame.key) {
+        return cpu.LoadState(keyState);
+    }
+
+    state.resize(frame.size);
+    return Decode(frame.data, keyState.data(), state.data(), state.size()) && cpu.LoadState(state);
+}
+
+void RewindBuffer::Clear()
+{
+    frames.clear();
+    stored = 0;
+    sinceKey = 0;
+}
+
+void RewindBuffer::SetBudget(size_t bytes)
+{
+    budget = bytes;
+    Trim();
+}
+
+size_t RewindBuffer::MemoryUsed() const
+{
+    size_t used = sizeof(*this) + frames.size() * sizeof(Frame);
+    for (const Frame& frame : frames) {
+        used += frame.data.capacity();
+    }
+    return used + state.capacity() + keyState.capacity() + coded.capacity();
+}
+
+void RewindBuffer::Trim()
+{
+    // whole groups only, a delta is no use without its keyframe. the newest group always stays
+    while (stored > budget) {
+        size_t next = 1;
+        while (next < frames.size() && !frames[next].key) {
+            next++;
+        }
+        if (next == frames.size()) {
+            break;
+        }
+
+        for (size_t i = 0; i < next; i++) {
+            stored -= frames.front().data.size();
+            frames.pop_front();
+        }
+    }
+}
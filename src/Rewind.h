@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+class CPU;
+
+/*
+
+Rewind buffer.
+
+Push() takes a savestate after every frame. Every keyframeInterval frames one is kept whole, the ones in between
+are XORed against the keyframe before them, and either way what gets stored is run length coded: a frame only
+changes a few hundred bytes of its ~64KB, so a delta is mostly long runs of zeros and ends up tiny. The XOR and
+the zero scanning go 16 bytes at a time with SSE2 on x86-64.
+
+Once the frames take more than the budget the oldest keyframe goes along with every delta that needs it.
+StepBack() goes back one frame at a time: decoding a delta against the keyframe (which is kept decoded) plus a
+LoadState, only stepping back over a keyframe decodes the one before it.
+
+*/
+
+class RewindBuffer
+{
+public:
+    // budget is in bytes and only counts the stored frames, MemoryUsed() has everything
+    explicit RewindBuffer(size_t budget, uint32_t keyframeInterval = 30);
+
+    void Push(const CPU& cpu);
+    bool StepBack(CPU& cpu); // false once there's nothing older to go back to
+    void Clear();
+
+    void SetBudget(size_t bytes); // drops the oldest frames straight away if it has to
+    size_t Budget() const { return budget; }
+    size_t Frames() const { return frames.size(); }
+    size_t MemoryUsed() const;
+
+private:
+    struct Frame
+    {
+        bool key;
+        uint32_t size; // of the state before it was coded
+        std::vector<uint8_t> data;
+    };
+
+    size_t budget;
+    uint32_t keyframeInterval;
+    std::deque<Frame> frames;
+    size_t stored = 0; // bytes in frames
+    uint32_t sinceKey = 0; // frames from the newest keyframe on, itself included
+
+    // working buffers, kept between calls so a push doesn't allocate more than the frame it keeps
+    std::vector<uint8_t> state;
+    std::vector<uint8_t> keyState; // the newest keyframe, decoded
+    std::vector<uint8_t> coded;
+
+    void Trim();
+};
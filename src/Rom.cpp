@@ -0,0 +1,137 @@
+#include "CPU.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<const RomImage> RomImage::Open(const char* path)
+{
+    // only ever touched while loading, never while anything runs
+    static std::mutex lock;
+    static std::unordered_map<std::string, std::weak_ptr<const RomImage>> loaded;
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    // drop images nobody holds anymore so the map doesn't grow with every path ever opened
+    for (auto it = loaded.begin(); it != loaded.end();) {
+        if (it->second.expired()) {
+            it = loaded.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // the last holder can still let go between the sweep and here, so a hit that locks to null loads again
+    std::shared_ptr<const RomImage> image;
+    auto found = loaded.find(path);
+    if (found != loaded.end()) {
+        image = found->second.lock();
+    }
+
+    // failed loads aren't remembered, the next Open just tries again
+    if (!image) {
+        image = Load(path);
+        if (image) {
+            loaded[path] = image;
+        } else if (found != loaded.end()) {
+            loaded.erase(found);
+        }
+    }
+
+    return image;
+}
+
+std::shared_ptr<const RomImage> RomImage::Load(const char* path)
+{
+    std::shared_ptr<RomImage> image(new RomImage());
+    size_t fileSize = 0;
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+
+    LARGE_INTEGER length;
+    if (GetFileSizeEx(file, &length)) {
+        fileSize = static_cast<size_t>(length.QuadPart);
+    }
+
+    if (fileSize && WholeBanks(fileSize)) {
+        HANDLE section = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (section) {
+            image->mapping = MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(section); // the view keeps it alive
+        }
+    }
+    CloseHandle(file);
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0) {
+        return nullptr;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) == 0) {
+        fileSize = static_cast<size_t>(info.st_size);
+    }
+
+    if (fileSize && WholeBanks(fileSize)) {
+        void* view = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, file, 0);
+        image->mapping = view == MAP_FAILED ? nullptr : view;
+    }
+    close(file);
+#endif
+
+    if (image->mapping) {
+        image->mappingSize = fileSize;
+        image->data = static_cast<const uint8_t*>(image->mapping);
+        image->size = fileSize;
+        return image;
+    }
+
+    // odd sized (or the mapping failed), read it the normal way
+    std::ifstream romFile(path, std::ios::binary | std::ios::ate);
+    if (!romFile.is_open()) {
+        return nullptr;
+    }
+
+    std::vector<uint8_t> bytes(static_cast<size_t>(romFile.tellg()));
+    romFile.seekg(0, std::ios::beg);
+    if (!romFile.read(reinterpret_cast<char*>(bytes.data()), bytes.size())) {
+        return nullptr;
+    }
+
+    return FromBytes(std::move(bytes));
+}
+
+std::shared_ptr<const RomImage> RomImage::FromBytes(std::vector<uint8_t> bytes)
+{
+    std::shared_ptr<RomImage> image(new RomImage());
+
+    size_t banks = (bytes.size() + BANK_SIZE - 1) / BANK_SIZE;
+    bytes.resize((banks < 2 ? 2 : banks) * BANK_SIZE, 0xFF);
+
+    image->copy = std::move(bytes);
+    image->data = image->copy.data();
+    image->size = image->copy.size();
+    return image;
+}
+
+RomImage::~RomImage()
+{
+    if (!mapping) {
+        return;
+    }
+
+#if defined(_WIN32)
+    UnmapViewOfFile(mapping);
+#else
+    munmap(mapping, mappingSize);
+#endif
+}
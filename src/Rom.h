@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+/*
+
+Read-only cartridge ROM image.
+
+Files are mapped into memory instead of being read in, so loading is instant whatever the size and only the
+banks a game actually uses ever get paged in. The cartridge maps its banks straight onto the mapping.
+
+Images never change once they're loaded, so any number of CPUs can run off the same one. Open hands out the
+image that's already loaded for a path if anything still holds it, so a batch of instances of the same game
+shares one copy of the ROM and each instance only owns its RAM, I/O and cartridge RAM.
+
+Images that aren't a whole number of 16KB banks (or are smaller than the 32KB every cartridge has) are read
+into a padded copy instead, the controller can pick any bank and they all have to be full.
+
+*/
+
+class RomImage
+{
+public:
+    static const size_t BANK_SIZE = 0x4000;
+
+    // null if the file can't be opened / mapped
+    static std::shared_ptr<const RomImage> Open(const char* path);
+    static std::shared_ptr<const RomImage> FromBytes(std::vector<uint8_t> bytes);
+
+    ~RomImage();
+
+    RomImage(const RomImage&) = delete;
+    RomImage& operator=(const RomImage&) = delete;
+
+    const uint8_t* Data() const { return data; }
+    size_t Size() const { return size; } // always a whole number of banks, at least two
+    bool Mapped() const { return mapping != nullptr; }
+
+private:
+    RomImage() = default;
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    void* mapping = nullptr;      // the file mapping, null when the image lives in `copy`
+    size_t mappingSize = 0;
+    std::vector<uint8_t> copy;
+
+    static std::shared_ptr<const RomImage> Load(const char* path);
+    static bool WholeBanks(size_t bytes) { return bytes >= 2 * BANK_SIZE && bytes % BANK_SIZE == 0; }
+};
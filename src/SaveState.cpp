@@ -0,0 +1,260 @@
+#include "CPU.h"
+#include "SaveState.h"
+
+static const char STATE_MAGIC[4] = { 'G', 'B', 'S', 'T' };
+static const uint32_t STATE_VERSION = 6; // goes up whenever anything in here changes shape
+
+enum StateKind : uint32_t { STATE_FULL, STATE_DELTA };
+
+struct StateHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t size;    // the whole state, header included
+    uint64_t romSize;
+    uint32_t romHash; // of the cartridge header, 0x134 - 0x14F
+    uint32_t kind;
+
+    // full states made by SaveBaseState are known by these, deltas carry the ones of their base
+    uint32_t baseSerial; // 0 for a full state that isn't a base
+    uint32_t memoryOffset; // full states: where 0x8000 - 0xFFFF starts, cartridge RAM comes straight after
+    uint64_t baseCycles;
+};
+
+static StateHeader MakeHeader(const Cartridge& cart, StateKind kind)
+{
+    StateHeader header{};
+    std::memcpy(header.magic, STATE_MAGIC, sizeof(header.magic));
+    header.version = STATE_VERSION;
+    header.romSize = cart.Loaded() ? cart.Image()->Size() : 0;
+    header.romHash = cart.HeaderHash(); // which ROM it belongs to, its banks are never stored
+    header.kind = kind;
+    return header;
+}
+
+static bool ReadHeader(const Cartridge& cart, const uint8_t* data, size_t size, StateKind kind, StateHeader& header)
+{
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+
+    return std::equal(STATE_MAGIC, STATE_MAGIC + 4, header.magic) && header.version == STATE_VERSION
+        && header.size == size && header.kind == kind
+        && header.romSize == (cart.Loaded() ? cart.Image()->Size() : 0) && header.romHash == cart.HeaderHash();
+}
+
+void CPU::SaveCore(StateWriter& state) const
+{
+    state.Value(registers);
+    state.Value(flags);
+    state.Value(pc);
+    state.Value(sp);
+    state.Value(IE);
+    state.Value(IF);
+    state.Value(IME);
+    state.Value(halted);
+    state.Value(stopped);
+    state.Value(cycles);
+    state.Value(frameCount);
+    state.Value(dmaActive);
+    state.Value(biosMapped);
+    state.Value(lazyOp);
+    state.Value(lazyOp1);
+    state.Value(lazyOp2);
+    state.Value(lazyCarry);
+    state.Value(lazyResult);
+
+    scheduler.SaveState(state);
+    display.SaveState(state);
+    timer.SaveState(state);
+    serial.SaveState(state);
+    joypad.SaveState(state);
+    cart.SaveState(state);
+}
+
+bool CPU::LoadCore(StateReader& state)
+{
+    state.Value(registers);
+    state.Value(flags);
+    state.Value(pc);
+    state.Value(sp);
+    state.Value(IE);
+    state.Value(IF);
+    state.Value(IME);
+    state.Value(halted);
+    state.Value(stopped);
+    state.Value(cycles);
+    state.Value(frameCount);
+    state.Value(dmaActive);
+    state.Value(biosMapped);
+    state.Value(lazyOp);
+    state.Value(lazyOp1);
+    state.Value(lazyOp2);
+    state.Value(lazyCarry);
+    state.Value(lazyResult);
+
+    return scheduler.LoadState(state) && display.LoadState(state) && timer.LoadState(state)
+        && serial.LoadState(state) && joypad.LoadState(state) && cart.LoadState(state);
+}
+
+void CPU::SaveState(std::vector<uint8_t>& out) const
+{
+    StateWriter state(out);
+
+    StateHeader header = MakeHeader(cart, STATE_FULL);
+    state.Value(header);
+
+    SaveCore(state);
+
+    // VRAM, WRAM, OAM, I/O and HRAM in one go, below 0x8000 is all ROM / boot ROM. cartridge RAM is the
+    // other big one, the size comes from the ROM header so it's the same for any state of this ROM
+    header.memoryOffset = static_cast<uint32_t>(state.Size());
+    state.Bytes(memory, 0x8000);
+    state.Bytes(cart.RamBytes(), cart.RamSize());
+
+    header.size = state.Size();
+    std::memcpy(state.At(0), &header, sizeof(header));
+}
+
+bool CPU::LoadState(const uint8_t* data, size_t size)
+{
+    StateHeader header;
+    if (!ReadHeader(cart, data, size, STATE_FULL, header)) {
+        return false;
+    }
+
+    StateReader state(data + sizeof(header), size - sizeof(header));
+
+    bool ok = LoadCore(state) && state.Bytes(memory, 0x8000)
+        && state.Bytes(cart.RamBytes(), cart.RamSize()) && state.Left() == 0;
+
+    if (trackDirty) {
+        ResetDirty(true); // nothing is known to match the base anymore
+    }
+
+#if GB_BLOCK_CACHE
+    // ROM blocks are keyed by bank and still good, anything decoded from RAM might not be
+    InvalidatePages(0x80, 0xFF);
+    blockGeneration++;
+#endif
+    MapMemory(); // banks, cartridge RAM and the boot ROM might all be mapped differently now
+
+    return ok;
+}
+
+void CPU::SaveBaseState(std::vector<uint8_t>& out)
+{
+    trackDirty = true;
+    baseSerial++;
+    baseCycles = cycles;
+    ResetDirty(false);
+
+    SaveState(out);
+
+    // the same as any full state, except deltas can find it
+    StateHeader header;
+    std::memcpy(&header, out.data(), sizeof(header));
+    header.baseSerial = baseSerial;
+    header.baseCycles = baseCycles;
+    std::memcpy(out.data(), &header, sizeof(header));
+}
+
+bool CPU::SaveDeltaState(std::vector<uint8_t>& out) const
+{
+    if (!trackDirty) {
+        return false;
+    }
+
+    StateWriter state(out);
+
+    StateHeader header = MakeHeader(cart, STATE_DELTA);
+    header.baseSerial = baseSerial;
+    header.baseCycles = baseCycles;
+    state.Value(header);
+
+    SaveCore(state);
+
+    // index and bytes of every page written since the base
+    size_t countAt = state.Size();
+    uint32_t count = 0;
+    state.Value(count);
+
+    int pages = static_cast<int>(0x100 + cart.RamSize() / 0x100);
+    for (int index = 0x80; index < pages; index++) {
+        if (IsDirty(index)) {
+            uint16_t page = static_cast<uint16_t>(index);
+            state.Value(page);
+            state.Bytes(PageBytes(index), 0x100);
+            count++;
+        }
+    }
+
+    std::memcpy(state.At(countAt), &count, sizeof(count));
+
+    header.size = state.Size();
+    std::memcpy(state.At(0), &header, sizeof(header));
+    return true;
+}
+
+bool CPU::LoadDeltaState(const std::vector<uint8_t>& base, const std::vector<uint8_t>& delta)
+{
+    StateHeader baseHeader;
+    StateHeader deltaHeader;
+    if (!ReadHeader(cart, base.data(), base.size(), STATE_FULL, baseHeader)
+        || !ReadHeader(cart, delta.data(), delta.size(), STATE_DELTA, deltaHeader)
+        || baseHeader.baseSerial == 0 || baseHeader.baseSerial != deltaHeader.baseSerial
+        || baseHeader.baseCycles != deltaHeader.baseCycles) {
+        return false;
+    }
+
+    // the pages that are dirty now are only dirty against this base if it's the one being tracked,
+    // otherwise go back to the base first and track from there
+    if (!trackDirty || baseSerial != baseHeader.baseSerial || baseCycles != baseHeader.baseCycles) {
+        if (!LoadState(base)) {
+            return false;
+        }
+        trackDirty = true;
+        baseSerial = baseHeader.baseSerial;
+        baseCycles = baseHeader.baseCycles;
+        ResetDirty(false);
+    }
+
+    StateReader state(delta.data() + sizeof(deltaHeader), delta.size() - sizeof(deltaHeader));
+
+    uint32_t count = 0;
+    bool ok = LoadCore(state) && state.Value(count);
+
+    int pages = static_cast<int>(0x100 + cart.RamSize() / 0x100);
+    deltaPages.assign(dirtyPages.size(), 0);
+
+    for (uint32_t i = 0; ok && i < count; i++) {
+        uint16_t index = 0;
+        ok = state.Value(index) && index >= 0x80 && index < pages && state.Bytes(PageBytes(index), 0x100);
+        if (ok) {
+            deltaPages[index >> 6] |= 1ull << (index & 63);
+        }
+    }
+    ok = ok && state.Left() == 0;
+
+    // written since the base but not by the time of the delta, they go back to what the base has
+    const uint8_t* baseMemory = base.data() + baseHeader.memoryOffset;
+    for (int index = 0x80; index < pages; index++) {
+        bool inDelta = (deltaPages[index >> 6] >> (index & 63)) & 1;
+        if (IsDirty(index) && !inDelta) {
+            std::memcpy(PageBytes(index), baseMemory + ((index - 0x80) << 8), 0x100);
+        }
+    }
+
+    // now it's the base plus the delta's pages
+    dirtyPages.swap(deltaPages);
+    dirtyPages[0xFF >> 6] |= 1ull << (0xFF & 63);
+
+#if GB_BLOCK_CACHE
+    InvalidatePages(0x80, 0xFF);
+    blockGeneration++;
+#endif
+    MapMemory();
+
+    return ok;
+}
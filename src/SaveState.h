@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+/*
+
+Savestates.
+
+A state is a header (magic, version, total size and which ROM it came from) followed by each piece of hardware
+one after another: CPU registers, the scheduler, the PPU, the timer, serial, the pad and the cartridge registers,
+then the 32KB from 0x8000 up and cartridge RAM in one go each. Nothing gets formatted or streamed, every part is
+copied straight into the buffer, and a buffer that gets reused keeps its capacity so saving doesn't even allocate.
+
+The ROM and the boot ROM aren't in there, they never change. Loading checks the header first and leaves the CPU
+alone if the state is from another version, another ROM or has been cut short.
+
+Delta states (SaveBaseState / SaveDeltaState) keep the small stuff the same way but instead of all of RAM only
+have the 256 byte pages written since the base state, which the bus keeps track of (Bus.cpp). A frame usually
+only touches a few, so a delta is a couple of KB instead of 64.
+
+*/
+
+class StateWriter
+{
+public:
+    explicit StateWriter(std::vector<uint8_t>& out) : out(out) { out.clear(); }
+
+    void Bytes(const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    }
+
+    template<typename T>
+    void Value(const T& value) { Bytes(&value, sizeof(T)); }
+
+    size_t Size() const { return out.size(); }
+    uint8_t* At(size_t offset) { return &out[offset]; } // for filling in the header once the size is known
+
+private:
+    std::vector<uint8_t>& out;
+};
+
+class StateReader
+{
+public:
+    StateReader(const uint8_t* data, size_t size) : at(data), end(data + size) {}
+
+    // false (and stays false) once something tries to read past the end
+    bool Bytes(void* data, size_t size)
+    {
+        if (!ok || static_cast<size_t>(end - at) < size) {
+            ok = false;
+            return false;
+        }
+        std::memcpy(data, at, size);
+        at += size;
+        return true;
+    }
+
+    template<typename T>
+    bool Value(T& value) { return Bytes(&value, sizeof(T)); }
+
+    bool Ok() const { return ok; }
+    size_t Left() const { return end - at; }
+
+private:
+    const uint8_t* at;
+    const uint8_t* end;
+    bool ok = true;
+};
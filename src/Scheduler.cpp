@@ -0,0 +1,66 @@
+#include "Scheduler.h"
+#include "SaveState.h"
+
+Scheduler::Scheduler()
+{
+    Clear();
+}
+
+void Scheduler::Schedule(EventType type, uint64_t when)
+{
+    deadlines[type] = when;
+    FindNext();
+}
+
+void Scheduler::Cancel(EventType type)
+{
+    deadlines[type] = NEVER;
+    FindNext();
+}
+
+void Scheduler::Clear()
+{
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        deadlines[i] = NEVER;
+    }
+    FindNext();
+}
+
+bool Scheduler::PopDue(uint64_t now, EventType& type, uint64_t& when)
+{
+    if (next > now) {
+        return false;
+    }
+
+    type = static_cast<EventType>(nextType);
+    when = next;
+
+    deadlines[type] = NEVER;
+    FindNext();
+    return true;
+}
+
+void Scheduler::FindNext()
+{
+    next = NEVER;
+    nextType = EVENT_COUNT;
+
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        if (deadlines[i] < next) {
+            next = deadlines[i];
+            nextType = static_cast<uint8_t>(i);
+        }
+    }
+}
+
+void Scheduler::SaveState(StateWriter& state) const
+{
+    state.Value(deadlines);
+    state.Value(next);
+    state.Value(nextType);
+}
+
+bool Scheduler::LoadState(StateReader& state)
+{
+    return state.Value(deadlines) && state.Value(next) && state.Value(nextType);
+}
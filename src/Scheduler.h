@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+class StateWriter;
+class StateReader;
+
+/*
+
+Event scheduler.
+
+Everything that happens at a known point in time (PPU interrupts, timer overflows, the end of a serial transfer,
+the end of an OAM DMA, the end of a frame) is an event with a deadline on the 64 bit cycle timebase. The CPU
+runs flat out until the earliest deadline and only then hands control to whatever hardware the event is for,
+nothing gets polled after each instruction.
+
+Each kind of hardware only ever has one thing pending, so there's one slot per event type instead of a heap.
+With this few slots finding the earliest is a short scan and it only happens when something gets scheduled.
+Events that are due at the same time fire in EventType order.
+
+*/
+
+enum EventType : uint8_t
+{
+    EVENT_PPU,       // next LCD mode change that requests an interrupt (Display)
+    EVENT_TIMER,     // next TIMA overflow (Timer)
+    EVENT_SERIAL,    // serial transfer finished (Serial)
+    EVENT_DMA,       // OAM DMA finished
+    EVENT_FRAME_END, // a frame's worth of cycles has gone by
+    EVENT_COUNT
+};
+
+class Scheduler
+{
+public:
+    static const uint64_t NEVER = UINT64_MAX;
+
+    Scheduler();
+
+    void Schedule(EventType type, uint64_t when);
+    void Cancel(EventType type);
+    void Clear();
+
+    bool Pending(EventType type) const { return deadlines[type] != NEVER; }
+    uint64_t When(EventType type) const { return deadlines[type]; }
+    uint64_t NextDeadline() const { return next; }
+
+    // takes the earliest event that's due by `now` off the schedule, false if there isn't one
+    bool PopDue(uint64_t now, EventType& type, uint64_t& when);
+
+    void SaveState(StateWriter& state) const;
+    bool LoadState(StateReader& state);
+
+private:
+    uint64_t deadlines[EVENT_COUNT];
+    uint64_t next = NEVER;
+    uint8_t nextType = EVENT_COUNT;
+
+    void FindNext();
+};
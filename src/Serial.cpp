@@ -0,0 +1,49 @@
+#include "CPU.h"
+
+Serial::Serial(CPU& cpu)
+    :cpu(cpu)
+{
+}
+
+void Serial::Write(uint16_t addr, uint8_t value, uint64_t now)
+{
+    switch (addr) {
+    case SB:
+        cpu.StoreByte(SB, value);
+        break;
+    case SC:
+        cpu.StoreByte(SC, 0x7E | value);
+
+        // only the internal clock does anything, with the external one the transfer would never finish anyway
+        if ((value & 0x81) == 0x81) {
+            output += static_cast<char>(cpu.Mem(SB));
+            cpu.scheduler.Schedule(EVENT_SERIAL, now + TRANSFER_CYCLES);
+        }
+        break;
+    }
+}
+
+void Serial::OnEvent(uint64_t)
+{
+    cpu.StoreByte(SB, 0xFF);
+    cpu.StoreByte(SC, cpu.Mem(SC) & 0x7F);
+    cpu.RequestInterrupt(3); // Serial
+}
+
+void Serial::SaveState(StateWriter& state) const
+{
+    uint32_t length = static_cast<uint32_t>(output.size());
+    state.Value(length);
+    state.Bytes(output.data(), length);
+}
+
+bool Serial::LoadState(StateReader& state)
+{
+    uint32_t length;
+    if (!state.Value(length) || length > state.Left()) {
+        return false;
+    }
+
+    output.resize(length);
+    return state.Bytes(&output[0], length);
+}
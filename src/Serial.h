@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+class CPU;
+class StateWriter;
+class StateReader;
+
+/*
+
+Serial port, with nothing on the other end of the cable.
+
+A transfer started with the internal clock takes 8 bits at 8192Hz (4096 cycles). It finishes as an
+EVENT_SERIAL, SB reads back 0xFF since nobody sent anything and the serial interrupt is requested.
+Every byte that gets sent is also kept in Output(), test ROMs print their results this way.
+
+*/
+
+class Serial
+{
+public:
+    // I/O registers this class owns
+    static const uint16_t SB = 0xFF01;
+    static const uint16_t SC = 0xFF02;
+
+    static const uint32_t TRANSFER_CYCLES = 8 * 512;
+
+    explicit Serial(CPU& cpu);
+
+    void Write(uint16_t addr, uint8_t value, uint64_t now);
+    void OnEvent(uint64_t when);
+
+    void SaveState(StateWriter& state) const;
+    bool LoadState(StateReader& state);
+
+    const std::string& Output() const { return output; }
+
+private:
+    CPU& cpu;
+    std::string output;
+};
@@ -0,0 +1,114 @@
+#include "CPU.h"
+
+Timer::Timer(CPU& cpu)
+    :cpu(cpu)
+{
+}
+
+void Timer::Reset(uint64_t now)
+{
+    counterStart = now;
+    lastUpdate = now;
+    cpu.StoreByte(DIV, 0);
+    cpu.StoreByte(TIMA, 0);
+    cpu.StoreByte(TMA, 0);
+    cpu.StoreByte(TAC, 0xF8);
+    ScheduleNext(now);
+}
+
+uint32_t Timer::TimaPeriod() const
+{
+    static const uint32_t periods[4] = { 1024, 16, 64, 256 };
+
+    uint8_t tac = cpu.Mem(TAC);
+    return (tac & 0x04) ? periods[tac & 0x03] : 0;
+}
+
+void Timer::Write(uint16_t addr, uint8_t value, uint64_t now)
+{
+    CatchUp(now); // counted with the old settings up to here
+
+    switch (addr) {
+    case DIV:
+        // any write clears the whole counter
+        counterStart = now;
+        cpu.StoreByte(DIV, 0);
+        break;
+    case TIMA:
+    case TMA:
+        cpu.StoreByte(addr, value);
+        break;
+    case TAC:
+        cpu.StoreByte(TAC, 0xF8 | value);
+        break;
+    }
+
+    ScheduleNext(now);
+}
+
+void Timer::OnEvent(uint64_t when)
+{
+    CatchUp(when);
+    ScheduleNext(when);
+}
+
+void Timer::InterruptEnableChanged(uint64_t now)
+{
+    CatchUp(now);
+    ScheduleNext(now);
+}
+
+void Timer::Advance(uint64_t now)
+{
+    cpu.StoreByte(DIV, static_cast<uint8_t>((now - counterStart) >> 8));
+
+    // TIMA goes up whenever the counter passes a multiple of the period. they all divide 0x10000, so counting
+    // on from counterStart in 64 bits gives the same ticks as the 16 bit counter wrapping round
+    uint32_t period = TimaPeriod();
+    if (period) {
+        uint64_t ticks = (now - counterStart) / period - (lastUpdate - counterStart) / period;
+
+        uint8_t tima = cpu.Mem(TIMA);
+        while (ticks) {
+            uint64_t untilOverflow = 0x100 - tima;
+            if (ticks < untilOverflow) {
+                tima = static_cast<uint8_t>(tima + ticks);
+                break;
+            }
+            ticks -= untilOverflow;
+            tima = cpu.Mem(TMA);
+            cpu.RequestInterrupt(2); // Timer
+        }
+        cpu.StoreByte(TIMA, tima);
+    }
+
+    lastUpdate = now;
+}
+
+void Timer::ScheduleNext(uint64_t now)
+{
+    // nothing can be woken by it with the interrupt off, the overflows get counted on the next catch up
+    uint32_t period = TimaPeriod();
+    if (!period || !(cpu.IE & 0x04)) {
+        cpu.scheduler.Cancel(EVENT_TIMER);
+        return;
+    }
+
+    // the next tick, then as many more as it takes TIMA to get past 0xFF
+    uint64_t nextTick = now + period - (now - counterStart) % period;
+    uint64_t overflow = nextTick + static_cast<uint64_t>(0xFF - cpu.Mem(TIMA)) * period;
+
+    cpu.scheduler.Schedule(EVENT_TIMER, overflow);
+    cpu.EndRunBy(overflow); // a TAC or TIMA write can make it sooner than the core was going to stop
+}
+
+void Timer::SaveState(StateWriter& state) const
+{
+    state.Value(counterStart);
+    state.Value(lastUpdate);
+}
+
+bool Timer::LoadState(StateReader& state)
+{
+    return state.Value(counterStart) && state.Value(lastUpdate);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+class CPU;
+class StateWriter;
+class StateReader;
+
+/*
+
+DIV / TIMA timer.
+
+DIV is the top byte of a 16 bit counter that goes up every cycle. TIMA goes up every 1024, 16, 64 or 256
+cycles (TAC bits 0-1) while TAC bit 2 is set, and when it overflows it's reloaded from TMA and the timer
+interrupt is requested.
+
+Neither is counted as it goes. Both follow from how long it's been since the counter was cleared, so DIV and
+TIMA are only worked out (CatchUp) when the CPU reads them, writes a timer register or CPU::Run hands back to
+the host. The only thing that has to happen on time is the interrupt, so EVENT_TIMER is scheduled for the
+next TIMA overflow and nothing else. With the timer off, or its interrupt disabled in IE, there are no events
+at all and the IF bit is set when IF is next looked at (CPU::ReadIO / WriteIO).
+
+*/
+
+class Timer
+{
+public:
+    // I/O registers this class owns
+    static const uint16_t DIV = 0xFF04;
+    static const uint16_t TIMA = 0xFF05;
+    static const uint16_t TMA = 0xFF06;
+    static const uint16_t TAC = 0xFF07;
+
+    explicit Timer(CPU& cpu);
+
+    void Reset(uint64_t now);
+    void Write(uint16_t addr, uint8_t value, uint64_t now);
+    void OnEvent(uint64_t when);
+    void InterruptEnableChanged(uint64_t now);
+
+    // DIV and TIMA as of `now`
+    void CatchUp(uint64_t now)
+    {
+        if (now > lastUpdate) {
+            Advance(now);
+        }
+    }
+
+    void SaveState(StateWriter& state) const;
+    bool LoadState(StateReader& state);
+
+private:
+    CPU& cpu;
+    uint64_t counterStart = 0; // when the 16 bit counter was last 0
+    uint64_t lastUpdate = 0;   // what DIV and TIMA in memory are up to date with
+
+    uint32_t TimaPeriod() const; // 0 while TIMA is stopped
+    void Advance(uint64_t now);
+    void ScheduleNext(uint64_t now); // EVENT_TIMER for the next overflow
+};
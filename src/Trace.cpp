@@ -0,0 +1,110 @@
+#include "Trace.h"
+
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+static const char TRACE_MAGIC[4] = { 'G', 'B', 'T', 'R' };
+static const uint32_t TRACE_VERSION = 1;
+
+struct TraceFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t pad;
+    uint64_t count;
+};
+
+TraceBuffer::TraceBuffer(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    records.resize(size);
+    mask = size - 1;
+}
+
+void TraceBuffer::Snapshot(std::vector<TraceRecord>& out) const
+{
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t count = end < records.size() ? end : records.size();
+    uint64_t begin = end - count;
+
+    out.resize(static_cast<size_t>(count));
+    for (uint64_t i = 0; i < count; i++) {
+        out[static_cast<size_t>(i)] = records[(begin + i) & mask];
+    }
+
+    // anything the writer lapped while we were copying could be torn, throw it away. the fence keeps the copy
+    // from moving below the head load, and record `after` counts as lapped too since it may be half written
+    // over the slot of `after - size` right now
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = head.load(std::memory_order_relaxed);
+    if (after + 1 - begin > records.size()) {
+        uint64_t torn = after + 1 - begin - records.size();
+        if (torn > count) {
+            torn = count;
+        }
+        out.erase(out.begin(), out.begin() + static_cast<ptrdiff_t>(torn));
+    }
+}
+
+bool TraceBuffer::WriteToFile(const char* path) const
+{
+    std::vector<TraceRecord> snapshot;
+    Snapshot(snapshot);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Could not open trace file " << path << std::endl;
+        return false;
+    }
+
+    TraceFileHeader header{};
+    std::copy(TRACE_MAGIC, TRACE_MAGIC + 4, header.magic);
+    header.version = TRACE_VERSION;
+    header.recordSize = sizeof(TraceRecord);
+    header.count = snapshot.size();
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(snapshot.data()), snapshot.size() * sizeof(TraceRecord));
+
+    return static_cast<bool>(file);
+}
+
+bool DecodeTrace(const char* path, std::ostream& out)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Could not open trace file " << path << std::endl;
+        return false;
+    }
+
+    TraceFileHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (!file || !std::equal(TRACE_MAGIC, TRACE_MAGIC + 4, header.magic)
+        || header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord)) {
+        std::cerr << "Error: " << path << " is not a trace file this build can read" << std::endl;
+        return false;
+    }
+
+    // registers are stored in CPU::registers order: a b c d e f h l
+    TraceRecord record;
+    for (uint64_t i = 0; i < header.count && file.read(reinterpret_cast<char*>(&record), sizeof(record)); i++) {
+        out << std::dec << std::setw(12) << std::setfill(' ') << record.cycles << std::hex << std::setfill('0')
+            << "  PC:" << std::setw(4) << record.pc
+            << " OP:" << std::setw(record.opcode > 0xFF ? 4 : 2) << record.opcode
+            << (record.opcode > 0xFF ? " " : "   ")
+            << " AF:" << std::setw(2) << +record.registers[0] << std::setw(2) << +record.registers[5]
+            << " BC:" << std::setw(2) << +record.registers[1] << std::setw(2) << +record.registers[2]
+            << " DE:" << std::setw(2) << +record.registers[3] << std::setw(2) << +record.registers[4]
+            << " HL:" << std::setw(2) << +record.registers[6] << std::setw(2) << +record.registers[7]
+            << " SP:" << std::setw(4) << record.sp << '\n';
+    }
+
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+#include <iostream>
+
+/*
+
+Instruction trace.
+
+The CPU pushes one fixed size binary record per instruction into a preallocated ring buffer,
+nothing gets formatted while the emulator runs. The buffer can be dumped to a file and turned
+into text afterwards with DecodeTrace (GameboyEmulator --decode-trace trace.bin).
+
+Only the CPU thread writes. Other threads can take a Snapshot() at any time without locking,
+records that got overwritten while they were being copied are dropped.
+
+*/
+
+struct TraceRecord
+{
+    uint64_t cycles;      // cycle count before the instruction ran
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t opcode;      // 0xCBxx for CB prefixed opcodes
+    uint8_t registers[8]; // same order as CPU::registers, F is worked out even with lazy flags
+    uint8_t pad[2];
+};
+
+static_assert(sizeof(TraceRecord) == 24, "trace files depend on the record size");
+
+class TraceBuffer
+{
+public:
+    explicit TraceBuffer(size_t capacity); // rounded up to a power of two
+
+    void Push(const TraceRecord& record)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        records[h & mask] = record;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    size_t Capacity() const { return records.size(); }
+    uint64_t Total() const { return head.load(std::memory_order_acquire); } // records pushed so far, including overwritten ones
+
+    void Snapshot(std::vector<TraceRecord>& out) const; // oldest first
+    bool WriteToFile(const char* path) const;
+
+private:
+    std::vector<TraceRecord> records;
+    size_t mask;
+    std::atomic<uint64_t> head{ 0 };
+};
+
+bool DecodeTrace(const char* path, std::ostream& out);
@@ -1,14 +1,186 @@
 #include "CPU.h"
+#include "Batch.h"
+#include "Rewind.h"
+#include "Movie.h"
 
 #undef main // this is just a cheap way to fix unresolved symbols. it tells the compiler that I don't want to use SDL_main
 
-int main()
+/*
+
+    GameboyEmulator [rom] [--trace out.bin] [--trace-size records] [--frames n] [--rewind MB]
+                    [--seed n] [--record movie.gbm | --replay movie.gbm] [--input pad.txt]
+                    [--screenshot out.pgm]
+    GameboyEmulator rom --ppu-check [--frames n] [--seed n]
+    GameboyEmulator --decode-trace out.bin
+    GameboyEmulator --batch [--jobs list.txt] [--threads n] [--frames n] [--cycles n] [rom...]
+
+*/
+
+// the last frame as a greyscale PGM, there's no window to show it in
+static bool WriteScreenshot(const Display& display, const char* path)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Could not open " << path << std::endl;
+        return false;
+    }
+
+    file << "P5\n" << Display::WIDTH << " " << Display::HEIGHT << "\n255\n";
+
+    const uint8_t* shades = display.Framebuffer();
+    for (int i = 0; i < Display::WIDTH * Display::HEIGHT; i++) {
+        file.put(static_cast<char>(255 - shades[i] * 85));
+    }
+
+    return static_cast<bool>(file);
+}
+
+// runs a second CPU off the same ROM with an event on every PPU mode change and compares the two after every
+// frame, the lazy PPU has to give exactly the same picture, memory and timing
+static bool CheckPpu(CPU& cpu, const char* romPath, long frames)
+{
+    CPU lockstep;
+    std::shared_ptr<const RomImage> image = RomImage::Open(romPath); // the one `cpu` already has
+    if (!image || !lockstep.LoadROM(image)) {
+        return false;
+    }
+    lockstep.SetSeed(cpu.GetSeed());
+    lockstep.display.SetLockstep(true);
+
+    long frame = 0;
+    while (frame < frames) {
+        cpu.RunFrame();
+        lockstep.RunFrame();
+
+        bool same = cpu.cycles == lockstep.cycles && cpu.pc == lockstep.pc && cpu.sp == lockstep.sp
+            && std::memcmp(cpu.registers, lockstep.registers, sizeof(cpu.registers)) == 0
+            && std::memcmp(cpu.memory, lockstep.memory, 0x8000) == 0
+            && std::memcmp(cpu.display.Framebuffer(), lockstep.display.Framebuffer(),
+                Display::WIDTH * Display::HEIGHT) == 0;
+
+        if (!same) {
+            std::cout << std::dec << "PPU check went different at frame " << frame << " of " << frames << std::endl;
+            return false;
+        }
+
+        frame++;
+        if (!cpu.running) {
+            break;
+        }
+    }
+
+    std::cout << std::dec << "PPU check matched all " << frame << " frames" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[])
 {
     try {
 
+        const char* romPath = "../ROMs/02.gb";
+        const char* tracePath = nullptr;
+        size_t traceSize = 1 << 20;
+        long frames = -1; // run until the cpu stops
+        bool batch = false;
+        const char* jobPath = nullptr;
+        unsigned threads = 0; // one per core
+        uint64_t cycleBudget = 0;
+        std::vector<std::string> roms;
+        size_t rewindBudget = 0; // off
+        const char* recordPath = nullptr;
+        const char* replayPath = nullptr;
+        const char* inputPath = nullptr;
+        uint64_t seed = 0;
+        const char* screenshotPath = nullptr;
+        bool ppuCheck = false;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+
+            if (arg == "--decode-trace" && i + 1 < argc) {
+                return DecodeTrace(argv[i + 1], std::cout) ? 0 : 1;
+            }
+            else if (arg == "--trace" && i + 1 < argc) {
+                tracePath = argv[++i];
+            }
+            else if (arg == "--trace-size" && i + 1 < argc) {
+                traceSize = std::stoul(argv[++i]);
+            }
+            else if (arg == "--frames" && i + 1 < argc) {
+                frames = std::stol(argv[++i]);
+            }
+            else if (arg == "--batch") {
+                batch = true;
+            }
+            else if (arg == "--jobs" && i + 1 < argc) {
+                jobPath = argv[++i];
+            }
+            else if (arg == "--threads" && i + 1 < argc) {
+                threads = std::stoul(argv[++i]);
+            }
+            else if (arg == "--cycles" && i + 1 < argc) {
+                cycleBudget = std::stoull(argv[++i]);
+            }
+            else if (arg == "--rewind" && i + 1 < argc) {
+                rewindBudget = std::stoul(argv[++i]) << 20;
+            }
+            else if (arg == "--seed" && i + 1 < argc) {
+                seed = std::stoull(argv[++i]);
+            }
+            else if (arg == "--record" && i + 1 < argc) {
+                recordPath = argv[++i];
+            }
+            else if (arg == "--replay" && i + 1 < argc) {
+                replayPath = argv[++i];
+            }
+            else if (arg == "--input" && i + 1 < argc) {
+                inputPath = argv[++i];
+            }
+            else if (arg == "--screenshot" && i + 1 < argc) {
+                screenshotPath = argv[++i];
+            }
+            else if (arg == "--ppu-check") {
+                ppuCheck = true;
+            }
+            else {
+                romPath = argv[i];
+                roms.push_back(arg);
+            }
+        }
+
+        if (batch) {
+            // a job has to end somewhere, a minute of emulated time unless told otherwise
+            BatchJob defaults;
+            defaults.frames = frames >= 0 ? frames : (cycleBudget ? 0 : 3600);
+            defaults.cycles = cycleBudget;
+
+            std::vector<BatchJob> jobs;
+            if (jobPath && !ReadJobFile(jobPath, defaults, jobs)) {
+                return 1;
+            }
+            for (const std::string& rom : roms) {
+                jobs.push_back(defaults);
+                jobs.back().romPath = rom;
+            }
+
+            std::vector<BatchResult> results = RunBatch(jobs, threads, std::cout);
+
+            // so scripts can tell from the exit code alone
+            for (const BatchResult& result : results) {
+                if (std::strcmp(result.status, "failed") == 0 || std::strcmp(result.status, "error") == 0) {
+                    return 1;
+                }
+            }
+            return 0;
+        }
+
         CPU cpu;
 
-        if (cpu.LoadROM("../ROMs/02.gb"))
+        if (tracePath) {
+            cpu.EnableTrace(traceSize);
+        }
+
+        if (cpu.LoadROM(romPath))
         {
             std::cout << "ROM loaded" << std::endl;
         }
@@ -18,19 +190,113 @@ int main()
             exit(1);
         }
 
-        std::cout << std::hex << std::setw(4) << std::setfill('0') << cpu.memory[0x100] << std::endl;
+        std::cout << std::hex << std::setw(4) << std::setfill('0') << cpu.ReadByte(0x100) << std::endl;
+
+        if (replayPath) {
+            Movie movie;
+            if (!movie.Load(replayPath)) {
+                return 1;
+            }
+            if (!movie.Matches(cpu)) {
+                std::cerr << "Error: " << replayPath << " was recorded with a different ROM" << std::endl;
+                return 1;
+            }
+
+            cpu.SetSeed(movie.seed);
 
-        while (true)
+            auto start = std::chrono::steady_clock::now();
+            uint64_t matched = PlayMovie(cpu, movie);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (matched == movie.Frames()) {
+                std::cout << std::dec << "Replay matched all " << matched << " frames, " << std::fixed
+                    << std::setprecision(0) << matched / seconds << " frames/s" << std::endl;
+                return 0;
+            }
+
+            std::cout << std::dec << "Replay went different at frame " << matched << " of " << movie.Frames() << std::endl;
+            return 1;
+        }
+
+        cpu.SetSeed(seed);
+
+        if (ppuCheck) {
+            return CheckPpu(cpu, romPath, frames >= 0 ? frames : 3600) ? 0 : 1; // a minute unless told otherwise
+        }
+
+        // the pad for each frame, what --record writes down
+        std::vector<Movie::Input> script;
+        size_t nextInput = 0;
+        if (inputPath && !ReadInputScript(inputPath, script)) {
+            return 1;
+        }
+
+        std::unique_ptr<Movie> movie;
+        if (recordPath) {
+            movie.reset(new Movie());
+            movie->Start(cpu);
+        }
+
+        std::unique_ptr<RewindBuffer> rewind;
+        if (rewindBudget) {
+            rewind.reset(new RewindBuffer(rewindBudget));
+        }
+
+        while (frames != 0)
         {
-            cpu.Update();
-            cpu.Cycle();
+            while (nextInput < script.size() && script[nextInput].frame <= cpu.frameCount) {
+                cpu.joypad.SetButtons(script[nextInput].buttons);
+                nextInput++;
+            }
+
+            if (movie) {
+                movie->Record(cpu);
+            }
+
+            cpu.RunFrame();
+
+            if (movie) {
+                movie->RecordHash(cpu);
+            }
+
+            if (rewind) {
+                rewind->Push(cpu);
+            }
 
             if (!cpu.running) {
                 break;
             }
+
+            if (frames > 0) {
+                frames--;
+            }
         }
 
         cpu.check_test();
+
+#if GB_BLOCK_CACHE
+        const CPU::BlockCacheStats& stats = cpu.GetBlockCacheStats();
+        std::cout << std::dec << "Block cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+            << stats.invalidations << " invalidations, " << cpu.CachedBlockCount() << " blocks, "
+            << stats.compiled << " compiled" << std::endl;
+#endif
+
+        if (rewind) {
+            std::cout << std::dec << "Rewind: " << rewind->Frames() << " frames, " << rewind->MemoryUsed() / 1024
+                << " KB used, budget " << rewind->Budget() / 1024 << " KB" << std::endl;
+        }
+
+        if (movie && movie->Save(recordPath)) {
+            std::cout << std::dec << "Movie of " << movie->Frames() << " frames written to " << recordPath << std::endl;
+        }
+
+        if (screenshotPath && WriteScreenshot(cpu.display, screenshotPath)) {
+            std::cout << "Screenshot written to " << screenshotPath << std::endl;
+        }
+
+        if (tracePath && cpu.trace->WriteToFile(tracePath)) {
+            std::cout << "Trace written to " << tracePath << std::endl;
+        }
     }
 
     catch (const std::exception& e) {
@@ -13,14 +13,14 @@ void CPU::OP_00() {
 }
 
 void CPU::OP_01() {
-    uint16_t address = (this->*addressModeTable[2])();
+    uint16_t address = Imm16();
     SetBC(address);
     pc += 3;
 }
 
 void CPU::OP_02() {
     uint16_t bc = GetBC();
-    memory[bc] = registers[A];
+    WriteByte(bc, registers[A]);
     pc += 1;
 }
 
@@ -31,26 +31,6 @@ void CPU::OP_03() {
     pc += 1;
 }
 
-void CPU::OP_04() {
-    signed int result = registers[B] += 1;
-    registers[B] = result;
-    UpdateFlagsAfterIncrement(B, result);
-    pc += 1;
-}
-
-void CPU::OP_05() {
-    signed int result = registers[B] -= 1;
-    registers[B] = result;
-    UpdateFlagsAfterDecrement(B, result);
-    pc += 1;
-}
-
-void CPU::OP_06() {
-    uint8_t address = (this->*addressModeTable[0])();
-    registers[B] = address;
-    pc += 2;
-}
-
 void CPU::OP_07() {
     // Rotate A left through the carry flag
     bool carryOut = (registers[A] & 0x80) != 0; // The bit that will be shifted out of A (bit 7)
@@ -68,9 +48,9 @@ void CPU::OP_07() {
 }
 
 void CPU::OP_08() {
-    uint16_t address = (this->*addressModeTable[1])();
-    memory[address] = sp & 0xFF;       // Store low byte
-    memory[address + 1] = (sp >> 8);   // Store high byte
+    uint16_t address = Imm16();
+    WriteByte(address, sp & 0xFF);       // Store low byte
+    WriteByte(address + 1, (sp >> 8));   // Store high byte
     pc += 3; // advance by 3 to skip the operands
 }
 
@@ -86,7 +66,7 @@ void CPU::OP_09() {
 
 void CPU::OP_0A() {
     uint16_t address = GetBC();
-    registers[A] = memory[address];
+    registers[A] = ReadByte(address);
     pc += 1;
 }
 
@@ -96,28 +76,8 @@ void CPU::OP_0B() {
     pc += 1;
 }
 
-void CPU::OP_0C() {
-    signed int result = registers[C] += 1;
-    registers[C] = result;
-    UpdateFlagsAfterIncrement(C, result);
-    pc += 1;
-}
-
-void CPU::OP_0D() {
-    signed int result = registers[C] -= 1;
-    registers[C] = result;
-    UpdateFlagsAfterDecrement(C, result);
-    pc += 1;
-}
-
-void CPU::OP_0E() {
-    uint8_t val = (this->*addressModeTable[0])();
-    registers[C] = val;
-    pc += 2;
-}
-
 void CPU::OP_0F() {
-    bool oldcarry = (flags & FLAG_C) != 0;
+    bool oldcarry = GetFlag(FLAG_C);
 
     uint8_t lsb = (registers[A] & 0x01);
     registers[A] = (registers[A] >> 1) | (oldcarry ? 0x80 : 0x00);
@@ -136,7 +96,7 @@ void CPU::OP_10()
 
 void CPU::OP_11()
 {
-    uint16_t address = (this->*addressModeTable[2])();
+    uint16_t address = Imm16();
     SetDE(address);
     pc += 3;
 }
@@ -144,7 +104,7 @@ void CPU::OP_11()
 void CPU::OP_12()
 {
     uint16_t DE = GetBC();
-    memory[DE] = registers[A];
+    WriteByte(DE, registers[A]);
     pc += 1;
 }
 
@@ -156,29 +116,6 @@ void CPU::OP_13()
     pc += 1;
 }
 
-void CPU::OP_14()
-{
-    signed int result = registers[D] += 1;
-    registers[D] = result;
-    UpdateFlagsAfterIncrement(D, result);
-    pc += 1;
-}
-
-void CPU::OP_15()
-{
-    signed int result = registers[D] -= 1;
-    registers[D] = result;
-    UpdateFlagsAfterDecrement(D, result);
-    pc += 1;
-}
-
-void CPU::OP_16()
-{
-    uint8_t address = (this->*addressModeTable[0])();
-    registers[D] = address;
-    pc += 2;
-}
-
 void CPU::OP_17()
 {
     uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
@@ -195,7 +132,7 @@ void CPU::OP_17()
 
 void CPU::OP_18()
 {
-    int8_t offset = (this->*addressModeTable[0])();
+    int8_t offset = Imm8();
     pc += (offset - 2);
 }
 
@@ -205,1255 +142,359 @@ void CPU::OP_19()
     int hl = GetHL();
     int result = hl + de;
 
-    SetHL(result & 0xFFFF);
-
-    UpdateFlagsAfterArithmetic(result, hl, de, false);
-    pc += 1;
-}
-
-void CPU::OP_1A()
-{
-    uint16_t address = GetDE();
-    registers[A] = memory[address];
-    pc += 1;
-}
-
-void CPU::OP_1B()
-{
-    uint16_t de = GetDE();
-    SetDE(de -= 1);
-    pc += 1;
-}
-
-void CPU::OP_1C()
-{
-    signed int result = registers[E] += 1;
-    registers[E] = result;
-    UpdateFlagsAfterIncrement(E, result);
-    pc += 1;
-}
-
-void CPU::OP_1D()
-{
-    signed int result = registers[E] -= 1;
-    registers[E] = result;
-    UpdateFlagsAfterDecrement(E, result);
-    pc += 1;
-}
-
-void CPU::OP_1E()
-{
-    val = (this->*addressModeTable[0])(); // Assuming this correctly fetches the immediate value
-    registers[E] = val;
-    pc += 2;
-}
-
-void CPU::OP_1F()
-{
-    // Get the current carry flag
-    uint8_t carry = (flags & FLAG_C) ? 1 : 0;
-
-    // Update the carry flag to the old bit 0 of register A
-    SetFlag(FLAG_C, registers[A] & 0x01);
-
-    // Rotate register A right through carry
-    registers[A] = (registers[A] >> 1) | (carry << 7);
-
-    // Update flags
-    SetFlag(FLAG_Z, 0); // Z flag is always reset
-    SetFlag(FLAG_N, 0); // N flag is always reset
-    SetFlag(FLAG_H, 0); // H flag is always reset
-
-    pc += 1;
-}
-
-void CPU::OP_20()
-{
-    int8_t offset = (this->*addressModeTable[0])();
-
-    if (!GetFlag(FLAG_Z)) {
-        pc += offset;
-    }
-    else {
-        pc += 2;
-    }
-}
-
-void CPU::OP_21()
-{
-    uint16_t address = (this->*addressModeTable[2])();
-    SetHL(address);
-    pc += 3;
-}
-
-void CPU::OP_22()
-{
-    uint16_t address = GetHL();
-    memory[address] = registers[A];
-    SetHL(address + 1);
-    pc += 1;
-}
-
-void CPU::OP_23()
-{
-    uint16_t hl = GetHL();
-    uint16_t result = hl += 1;
-    SetHL(result);
-    pc += 1;
-}
-
-void CPU::OP_24()
-{
-    signed int result = registers[H] += 1;
-    registers[H] = result;
-    UpdateFlagsAfterIncrement(H, result);
-    pc += 1;
-}
-
-void CPU::OP_25()
-{
-    signed int result = registers[H] -= 1;
-    registers[H] = result;
-    UpdateFlagsAfterDecrement(H, result);
-    pc += 1;
-}
-
-void CPU::OP_26()
-{
-    uint8_t address = (this->*addressModeTable[0])();
-    registers[D] = address;
-    pc += 1;
-}
-
-void CPU::OP_27()
-{
-    uint8_t correction = 0;
-
-    if (!GetFlag(FLAG_N)) { // Addition
-        if (GetFlag(H) || (registers[A] & 0x0F) > 9) {
-            correction = 0x06;
-        }
-        if (GetFlag(C) || (registers[A] > 0x99)) {
-            correction |= 0x60;
-            SetFlag(C, true);
-        }
-    }
-    else { // Subtraction
-        if (GetFlag(H)) {
-            correction = 0x06;
-        }
-        if (GetFlag(C)) {
-            correction |= 0x60;
-        }
-    }
-
-    registers[A] += GetFlag(FLAG_N) ? -correction : correction;
-
-    SetFlag(H, false);
-    SetFlag(FLAG_Z, registers[A] == 0);
-
-    pc += 1;
-}
-
-void CPU::OP_28()
-{
-    int8_t offset = (this->*addressModeTable[0])();
-
-    if (GetFlag(FLAG_Z)) {
-        pc += offset;
-    }
-    else {
-        pc += 2;
-    }
-}
-
-void CPU::OP_29()
-{
-    int hl = GetHL();
-    int result = hl + hl;
-
-    SetHL(result & 0xFFFF);
-
-    UpdateFlagsAfterArithmetic(result, hl, hl, false);
-
-    pc += 1;
-}
-
-void CPU::OP_2A()
-{
-    uint16_t address = GetHL();
-    registers[A] = memory[address];
-    SetHL(address + 1);
-    pc += 1;
-}
-
-void CPU::OP_2B()
-{
-    uint16_t hl = GetHL();
-    SetHL(hl += 1);
-    pc += 1;
-}
-
-void CPU::OP_2C()
-{
-    signed int result = registers[L] += 1;
-    registers[L] = result;
-    UpdateFlagsAfterIncrement(L, result);
-    pc += 1;
-}
-
-void CPU::OP_2D()
-{
-    signed int result = registers[L] -= 1;
-    registers[L] = result;
-    UpdateFlagsAfterDecrement(L, result);
-    pc += 1;
-}
-
-void CPU::OP_2E()
-{
-    uint8_t val = (this->*addressModeTable[0])();
-    registers[L] = val;
-    pc += 2;
-}
-
-void CPU::OP_2F()
-{
-    registers[A] = ~registers[A];
-    SetFlag(FLAG_N, true);
-    SetFlag(FLAG_H, true);
-    pc += 1;
-}
-
-void CPU::OP_30()
-{
-    int8_t offset = (this->*addressModeTable[0])();
-
-    if (!GetFlag(FLAG_C)) {
-        pc += offset;
-    }
-    else {
-        pc += 2;
-    }
-}
-
-void CPU::OP_31() {
-    uint16_t address = (memory[pc + 1] | (memory[pc + 2] << 8));
-
-    sp = address;
-
-    pc += 3;
-}
-
-void CPU::OP_32()
-{
-    uint16_t address = GetHL();
-    memory[address] = registers[A];
-    SetHL(address - 1);
-    pc += 1;
-}
-
-void CPU::OP_33()
-{
-    uint16_t value = sp + 1;
-    memory[sp + 1] = value & 0xFF;
-    memory[sp + 2] = (value >> 8) & 0xFF;
-    pc += 1;
-}
-
-void CPU::OP_34()
-{
-    uint16_t hl = GetHL();
-    uint8_t value = memory[hl];
-    value += 1;
-    memory[hl] = value;
-
-    UFAI16(hl, value);
-    pc += 1;
-}
-
-void CPU::OP_35()
-{
-    uint16_t hl = GetHL();
-    uint8_t value = memory[hl];
-    value -= 1;
-    memory[hl] = value;
-
-    UFAD16(hl, value);
-
-    pc += 1;
-}
-
-void CPU::OP_36()
-{
-    uint8_t val = (this->*addressModeTable[0])(); // use immediate addressing to get d8
-    uint16_t hl = GetHL();
-    memory[hl] = val;
-    pc += 2;
-}
-
-void CPU::OP_37()
-{
-    SetFlag(FLAG_C, true);
-    SetFlag(FLAG_H, false);
-    SetFlag(FLAG_N, false);
-    pc += 1;
-}
-
-void CPU::OP_38()
-{
-    int8_t offset = (this->*addressModeTable[0])();
-
-    if (GetFlag(FLAG_C)) {
-        pc += offset;
-    }
-    else {
-        pc += 2;
-    }
-}
-
-void CPU::OP_39()
-{
-    int hl = GetHL();
-    int result = hl + sp;
-
-    SetHL(result & 0xFFFF);
-
-    UpdateFlagsAfterArithmetic(result, hl, sp, false);
-
-    pc += 1;
-}
-
-void CPU::OP_3A()
-{
-    uint16_t address = GetHL();
-    registers[A] = memory[address];
-    SetHL(address - 1);
-    pc += 1;
-}
-
-void CPU::OP_3B()
-{
-    sp -= 1;
-    pc += 1;
-}
-
-void CPU::OP_3C()
-{
-    int result = registers[A] += 1;
-    UpdateFlagsAfterIncrement(A, result);
-    pc += 1;
-}
-
-void CPU::OP_3D()
-{
-    int result = registers[A] -= 1;
-    UpdateFlagsAfterDecrement(A, result);
-    pc += 1;
-}
-
-void CPU::OP_3E()
-{
-    uint8_t val = (this->*addressModeTable[0])();
-    registers[A] = val;
-    pc += 2;
-}
-
-void CPU::OP_3F()
-{
-    bool carry = GetFlag(FLAG_C);
-    SetFlag(FLAG_C, !carry);
-    SetFlag(FLAG_H, false);
-    SetFlag(FLAG_N, false);
-    pc += 1;
-}
-
-void CPU::OP_40() {
-    // just loads b into b doesn't have to do anything
-    pc += 1;
-}
-
-void CPU::OP_41() {
-    registers[B] = registers[C];
-    pc += 1;
-}
-
-void CPU::OP_42() {
-    registers[B] = registers[D];
-    pc += 1;
-}
-
-void CPU::OP_43() {
-    registers[B] = registers[E];
-    pc += 1;
-}
-
-void CPU::OP_44() {
-    registers[B] = registers[H];
-    pc += 1;
-}
-
-void CPU::OP_45() {
-    registers[B] = registers[L];
-    pc += 1;
-}
-
-void CPU::OP_46() 
-{
-    registers[B] = memory[GetHL()];
-    pc += 1;
-}
-
-void CPU::OP_47() {
-    registers[B] = registers[A];
-    pc += 1;
-}
-
-void CPU::OP_48() 
-{
-    registers[C] = registers[B];
-    pc += 1;
-}
-
-void CPU::OP_49() {
-    //load c into c doesn't have to do anything
-    pc += 1;
-}
-
-void CPU::OP_4A() {
-    registers[C] = registers[D];
-    pc += 1;
-}
-
-void CPU::OP_4B() {
-    registers[C] = registers[E];
-    pc += 1;
-}
-
-void CPU::OP_4C() {
-    registers[C] = registers[H];
-    pc += 1;
-}
-
-void CPU::OP_4D() {
-    registers[C] = registers[L];
-    pc += 1;
-}
-
-void CPU::OP_4E() 
-{
-    registers[C] = memory[GetHL()];
-    pc += 1;
-}
-
-void CPU::OP_4F() {
-    registers[C] = registers[A];
-    pc += 1;
-}
-
-void CPU::OP_50() {
-    registers[D] = registers[B];
-    pc += 1;
-}
-
-void CPU::OP_51() {
-    registers[D] = registers[C];
-    pc += 1;
-}
-
-void CPU::OP_52() {
-    // no load
-    pc += 1;
-}
-
-void CPU::OP_53() {
-    registers[D] = registers[E];
-    pc += 1;
-}
-
-void CPU::OP_54() {
-    registers[D] = registers[H];
-    pc += 1;
-}
-
-void CPU::OP_55() {
-    registers[D] = registers[L];
-    pc += 1;
-}
-
-void CPU::OP_56() {
-    registers[D] = memory[GetHL()];
-    pc += 1;
-}
-
-void CPU::OP_57() {
-    registers[D] = registers[A];
-    pc += 1;
-}
-
-void CPU::OP_58() {
-    registers[E] = registers[B];
-    pc += 1;
-}
-
-void CPU::OP_59() {
-    registers[E] = registers[C];
-    pc += 1;
-}
-
-void CPU::OP_5A() {
-    registers[E] = registers[D];
-    pc += 1;
-}
-
-void CPU::OP_5B() {
-    // no load
-    pc += 1;
-}
-
-void CPU::OP_5C() {
-    registers[E] = registers[H];
-    pc += 1;
-}
-
-void CPU::OP_5D() {
-    registers[E] = registers[L];
-    pc += 1;
-}
-
-void CPU::OP_5E() {
-    registers[E] = memory[GetHL()];
-    pc += 1;
-}
-
-void CPU::OP_5F() {
-    registers[E] = registers[A];
-    pc += 1;
-}
-
-void CPU::OP_60() {
-    registers[H] = registers[B];
-    pc += 1;
-}
-
-void CPU::OP_61() {
-    registers[H] = registers[C];
-    pc += 1;
-}
-
-void CPU::OP_62() {
-    registers[H] = registers[D];
-    pc += 1;
-}
-
-void CPU::OP_63() {
-    registers[H] = registers[E];
-    pc += 1;
-}
-
-void CPU::OP_64() {
-    // no load
-    pc += 1;
-}
-
-void CPU::OP_65() {
-    registers[H] = registers[L];
-    pc += 1;
-}
-
-void CPU::OP_66() {
-    registers[H] = memory[GetHL()];
-    pc += 1;
-}
-
-void CPU::OP_67() {
-    registers[H] = registers[A];
-    pc += 1;
-}
-
-void CPU::OP_68() {
-    registers[L] = registers[B];
-    pc += 1;
-}
-
-void CPU::OP_69() {
-    registers[L] = registers[C];
-    pc += 1;
-}
-
-void CPU::OP_6A() {
-    registers[L] = registers[D];
-    pc += 1;
-}
-
-void CPU::OP_6B() {
-    registers[L] = registers[E];
-    pc += 1;
-}
-
-void CPU::OP_6C() {
-    registers[L] = registers[H];
-    pc += 1;
-}
-
-void CPU::OP_6D() {
-    // no load 
-    pc += 1;
-}
-
-void CPU::OP_6E() {
-    registers[L] = memory[GetHL()];
-    pc += 1;
-}
-
-void CPU::OP_6F() {
-    registers[L] = registers[A];
-    pc += 1;
-}
-
-void CPU::OP_70() {
-    memory[GetHL()] = registers[B];
-    pc += 1;
-}
-
-void CPU::OP_71() {
-    memory[GetHL()] = registers[C];
-    pc += 1;
-}
-
-void CPU::OP_72() {
-    memory[GetHL()] = registers[D];
-    pc += 1;
-}
-
-void CPU::OP_73() {
-    memory[GetHL()] = registers[E];
-    pc += 1;
-}
-
-void CPU::OP_74() {
-    memory[GetHL()] = registers[H];
-    pc += 1;
-}
-
-void CPU::OP_75() {
-    memory[GetHL()] = registers[C];
-    pc += 1;
-}
-
-void CPU::OP_76() {
-    halted = true;
-    pc += 1;
-}
-
-void CPU::OP_77() {
-    memory[GetHL()] = registers[A];
-    pc += 1;
-}
-
-void CPU::OP_78() {
-    registers[A] = registers[B];
-    pc += 1;
-}
-
-void CPU::OP_79() {
-    registers[A] = registers[C];
-    pc += 1;
-}
-
-void CPU::OP_7A() {
-    registers[A] = registers[D];
-    pc += 1;
-}
-
-void CPU::OP_7B() {
-    registers[A] = registers[E];
-    pc += 1;
-}
-
-void CPU::OP_7C() {
-    registers[A] = registers[H];
-    pc += 1;
-}
-
-void CPU::OP_7D() {
-    registers[A] = registers[L];
-    pc += 1;
-}
-
-void CPU::OP_7E() {
-    registers[A] = memory[GetHL()];
-    pc += 1;
-}
-
-void CPU::OP_7F() {
-    // no load
-    pc += 1;
-}
-
-void CPU::OP_80() {
-    uint16_t result = registers[A] + registers[B];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[B], false);
-    pc += 1;
-}
-
-void CPU::OP_81() {
-    uint16_t result = registers[A] + registers[C];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[C], false);
-    pc += 1;
-}
-
-void CPU::OP_82() {
-    uint16_t result = registers[A] + registers[D];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[D], false);
-    pc += 1;
-}
-
-void CPU::OP_83() {
-    uint16_t result = registers[A] + registers[E];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[E], false);
-    
-    pc += 1;
-}
-
-void CPU::OP_84() {
-    uint16_t result = registers[A] + registers[H];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[H], false);
-    
-    pc += 1;
-}
-
-void CPU::OP_85() {
-    uint16_t result = registers[A] + registers[L];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[L], false);
-    
-    pc += 1;
-}
-
-void CPU::OP_86() {
-    uint8_t value = memory[GetHL()];
-    uint16_t result = registers[A] + value; 
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], memory[GetHL()], false);
-
-    pc += 1;
-}
-
-void CPU::OP_87() {
-    uint16_t result = registers[A] + registers[A];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[A], false);
-
-    pc += 1;
-}
-
-void CPU::OP_88() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] + registers[B] + carry;
-    
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-    
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[B] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
-    pc += 1;
-}
-
-void CPU::OP_89() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] + registers[C] + carry;
-
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[C] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
-    pc += 1;
-}
-
-void CPU::OP_8A() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] + registers[D] + carry;
-    
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-    
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[D] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
-    pc += 1;
-}
-
-void CPU::OP_8B() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] + registers[E] + carry;
-
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[E] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
-    pc += 1;
-}
-
-void CPU::OP_8C() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] + registers[H] + carry;
-
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[H] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
-    pc += 1;
-}
-
-void CPU::OP_8D() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] + registers[L] + carry;
-
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[L] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
-    pc += 1;
-}
-
-void CPU::OP_8E() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] + memory[GetHL()] + carry;
-
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-
-    bool halfcarry = ((registers[A] & 0x0F) + (memory[GetHL()] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
-    pc += 1;
-}
-
-void CPU::OP_8F() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] + registers[A] + carry;
-
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[A] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
-    pc += 1;
-}
-
-void CPU::OP_90() {
-    uint16_t result = registers[A] - registers[B];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[B], true);
-    pc += 1;
-}
-
-void CPU::OP_91() {
-    uint16_t result = registers[A] - registers[C];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[C], true);
-    pc += 1;
-}
-
-void CPU::OP_92() {
-    uint16_t result = registers[A] - registers[D];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[D], true);
-    pc += 1;
-}
-
-void CPU::OP_93() {
-    uint16_t result = registers[A] - registers[E];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[E], true);
-    pc += 1;
-}
-
-void CPU::OP_94() {
-    uint16_t result = registers[A] - registers[H];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[H], true);
-    pc += 1;
-}
-
-void CPU::OP_95() {
-    uint16_t result = registers[A] - registers[L];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[L], true);
-    pc += 1;
-}
-
-void CPU::OP_96() {
-    uint16_t result = registers[A] - memory[GetHL()];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], memory[GetHL()], true);
-    pc += 1;
-}
-
-void CPU::OP_97() {
-    uint16_t result = registers[A] - registers[A];
-    registers[A] = result & 0xFF;
-    UFARA(result, registers[A], registers[A], true);
-    pc += 1;
-}
-
-void CPU::OP_98() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] - registers[B] - carry;
-
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[B] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
-    pc += 1;
-}
-
-void CPU::OP_99() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] - registers[C] - carry;
-
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[C] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
+    SetHL(result & 0xFFFF);
 
-    SetFlag(FLAG_C, result > 0xFF);
+    UpdateFlagsAfterArithmetic(result, hl, de, false);
     pc += 1;
 }
 
-void CPU::OP_9A() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] - registers[D] - carry;
-
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[D] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
+void CPU::OP_1A()
+{
+    uint16_t address = GetDE();
+    registers[A] = ReadByte(address);
     pc += 1;
 }
 
-void CPU::OP_9B() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] - registers[E] - carry;
-
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[E] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
+void CPU::OP_1B()
+{
+    uint16_t de = GetDE();
+    SetDE(de -= 1);
     pc += 1;
 }
 
-void CPU::OP_9C() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] - registers[H] - carry;
+void CPU::OP_1F()
+{
+    // Get the current carry flag
+    uint8_t carry = CarryFlag();
 
-    registers[A] = result & 0xFF;
+    // Update the carry flag to the old bit 0 of register A
+    SetFlag(FLAG_C, registers[A] & 0x01);
 
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
+    // Rotate register A right through carry
+    registers[A] = (registers[A] >> 1) | (carry << 7);
 
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[H] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
+    // Update flags
+    SetFlag(FLAG_Z, 0); // Z flag is always reset
+    SetFlag(FLAG_N, 0); // N flag is always reset
+    SetFlag(FLAG_H, 0); // H flag is always reset
 
-    SetFlag(FLAG_C, result > 0xFF);
     pc += 1;
 }
 
-void CPU::OP_9D() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] - registers[L] - carry;
-
-    registers[A] = result & 0xFF;
+void CPU::OP_20()
+{
+    int8_t offset = Imm8();
 
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
+    if (!GetFlag(FLAG_Z)) {
+        pc += offset;
+    }
+    else {
+        pc += 2;
+    }
+}
 
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[L] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
+void CPU::OP_21()
+{
+    uint16_t address = Imm16();
+    SetHL(address);
+    pc += 3;
+}
 
-    SetFlag(FLAG_C, result > 0xFF);
+void CPU::OP_22()
+{
+    uint16_t address = GetHL();
+    WriteByte(address, registers[A]);
+    SetHL(address + 1);
     pc += 1;
 }
 
-void CPU::OP_9E() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] - memory[GetHL()] - carry;
-
-    registers[A] = result & 0xFF;
+void CPU::OP_23()
+{
+    uint16_t hl = GetHL();
+    uint16_t result = hl += 1;
+    SetHL(result);
+    pc += 1;
+}
 
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
+void CPU::OP_27()
+{
+    ResolveFlags();
 
-    bool halfcarry = ((registers[A] & 0x0F) + (memory[GetHL()] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
+    uint16_t entry = AluDaa(registers[A], flags >> 4); // index is N, H and C
+    registers[A] = entry >> 8;
+    SetFlags(entry & 0xFF);
 
-    SetFlag(FLAG_C, result > 0xFF);
     pc += 1;
 }
 
-void CPU::OP_9F() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t result = registers[A] - registers[A] - carry;
+void CPU::OP_28()
+{
+    int8_t offset = Imm8();
 
-    registers[A] = result & 0xFF;
+    if (GetFlag(FLAG_Z)) {
+        pc += offset;
+    }
+    else {
+        pc += 2;
+    }
+}
 
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
+void CPU::OP_29()
+{
+    int hl = GetHL();
+    int result = hl + hl;
 
-    bool halfcarry = ((registers[A] & 0x0F) + (registers[A] & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
+    SetHL(result & 0xFFFF);
 
-    SetFlag(FLAG_C, result > 0xFF);
-    pc += 1;
-}
+    UpdateFlagsAfterArithmetic(result, hl, hl, false);
 
-void CPU::OP_A0() {
-    uint8_t result = registers[A] &= registers[B];
-    UFAAO(result);
     pc += 1;
 }
 
-void CPU::OP_A1() {
-    uint8_t result = registers[A] &= registers[C];
-    UFAAO(result);
+void CPU::OP_2A()
+{
+    uint16_t address = GetHL();
+    registers[A] = ReadByte(address);
+    SetHL(address + 1);
     pc += 1;
 }
 
-void CPU::OP_A2() {
-    uint8_t result = registers[A] &= registers[D];
-    UFAAO(result);
+void CPU::OP_2B()
+{
+    uint16_t hl = GetHL();
+    SetHL(hl += 1);
     pc += 1;
 }
 
-void CPU::OP_A3() {
-    uint8_t result = registers[A] &= registers[E];
-    UFAAO(result);
+void CPU::OP_2F()
+{
+    registers[A] = ~registers[A];
+    SetFlag(FLAG_N, true);
+    SetFlag(FLAG_H, true);
     pc += 1;
 }
 
-void CPU::OP_A4() {
-    uint8_t result = registers[A] &= registers[H];
-    UFAAO(result);
-    pc += 1;
-}
+void CPU::OP_30()
+{
+    int8_t offset = Imm8();
 
-void CPU::OP_A5() {
-    uint8_t result = registers[A] &= registers[L];
-    UFAAO(result);
-    pc += 1;
+    if (!GetFlag(FLAG_C)) {
+        pc += offset;
+    }
+    else {
+        pc += 2;
+    }
 }
 
-void CPU::OP_A6() {
-    uint8_t result = registers[A] &= memory[GetHL()];
-    UFAAO(result);
-    pc += 1;
-}
+void CPU::OP_31() {
+    uint16_t address = Imm16();
 
-void CPU::OP_A7() {
-    uint8_t result = registers[A] &= registers[A];
-    UFAAO(result);
-    pc += 1;
-}
+    sp = address;
 
-void CPU::OP_A8() {
-    uint8_t result = registers[A] ^= registers[B];
-    UFAOXO(result);
-    pc += 1;
+    pc += 3;
 }
 
-void CPU::OP_A9() {
-    uint8_t result = registers[A] ^= registers[C];
-    UFAOXO(result);
+void CPU::OP_32()
+{
+    uint16_t address = GetHL();
+    WriteByte(address, registers[A]);
+    SetHL(address - 1);
     pc += 1;
 }
 
-void CPU::OP_AA() {
-    uint8_t result = registers[A] ^= registers[D];
-    UFAOXO(result);
+void CPU::OP_33()
+{
+    uint16_t value = sp + 1;
+    WriteByte(sp + 1, value & 0xFF);
+    WriteByte(sp + 2, (value >> 8) & 0xFF);
     pc += 1;
 }
 
-void CPU::OP_AB() {
-    uint8_t result = registers[A] ^= registers[E];
-    UFAOXO(result);
+void CPU::OP_37()
+{
+    SetFlag(FLAG_C, true);
+    SetFlag(FLAG_H, false);
+    SetFlag(FLAG_N, false);
     pc += 1;
 }
 
-void CPU::OP_AC() {
-    uint8_t result = registers[A] ^= registers[H];
-    UFAOXO(result);
-    pc += 1;
-}
+void CPU::OP_38()
+{
+    int8_t offset = Imm8();
 
-void CPU::OP_AD() {
-    uint8_t result = registers[A] ^= registers[L];
-    UFAOXO(result);
-    pc += 1;
+    if (GetFlag(FLAG_C)) {
+        pc += offset;
+    }
+    else {
+        pc += 2;
+    }
 }
 
-void CPU::OP_AE() {
-    uint8_t result = registers[A] ^= memory[GetHL()];
-    UFAOXO(result);
-    pc += 1;
-}
+void CPU::OP_39()
+{
+    int hl = GetHL();
+    int result = hl + sp;
 
-void CPU::OP_AF() {
-    uint8_t result = registers[A] ^= registers[A];
-    UFAOXO(result);
-    pc += 1;
-}
+    SetHL(result & 0xFFFF);
 
-void CPU::OP_B0() {
-    uint8_t result = registers[A] |= registers[B];
-    UFAOXO(result);
-    pc += 1;
-}
+    UpdateFlagsAfterArithmetic(result, hl, sp, false);
 
-void CPU::OP_B1() {
-    uint8_t result = registers[A] |= registers[C];
-    UFAOXO(result);
     pc += 1;
 }
 
-void CPU::OP_B2() {
-    uint8_t result = registers[A] |= registers[D];
-    UFAOXO(result);
+void CPU::OP_3A()
+{
+    uint16_t address = GetHL();
+    registers[A] = ReadByte(address);
+    SetHL(address - 1);
     pc += 1;
 }
 
-void CPU::OP_B3() {
-    uint8_t result = registers[A] |= registers[E];
-    UFAOXO(result);
+void CPU::OP_3B()
+{
+    sp -= 1;
     pc += 1;
 }
 
-void CPU::OP_B4() {
-    uint8_t result = registers[A] |= registers[H];
-    UFAOXO(result);
+void CPU::OP_3F()
+{
+    bool carry = GetFlag(FLAG_C);
+    SetFlag(FLAG_C, !carry);
+    SetFlag(FLAG_H, false);
+    SetFlag(FLAG_N, false);
     pc += 1;
 }
 
-void CPU::OP_B5() {
-    uint8_t result = registers[A] |= registers[L];
-    UFAOXO(result);
-    pc += 1;
+#pragma region templated_handlers
+template<uint8_t r>
+inline uint8_t CPU::ReadR8()
+{
+    return registers[r];
 }
 
-void CPU::OP_B6() {
-    uint8_t result = registers[A] |= memory[GetHL()];
-    UFAOXO(result);
-    pc += 1;
+template<>
+inline uint8_t CPU::ReadR8<HL_IND>()
+{
+    return ReadByte(GetHL());
 }
 
-void CPU::OP_B7() {
-    uint8_t result = registers[A] |= registers[A];
-    UFAOXO(result);
-    pc += 1;
+template<>
+inline uint8_t CPU::ReadR8<IMM8>()
+{
+    return Imm8();
 }
 
-void CPU::OP_B8() {
-    uint8_t result = registers[A] - registers[B];
-    UFARA(result, registers[A], registers[B], true);
-    pc += 1;
+template<uint8_t r>
+inline void CPU::WriteR8(uint8_t value)
+{
+    registers[r] = value;
 }
 
-void CPU::OP_B9() {
-    uint8_t result = registers[A] - registers[C];
-    UFARA(result, registers[A], registers[C], true);
-    pc += 1;
+template<>
+inline void CPU::WriteR8<HL_IND>(uint8_t value)
+{
+    WriteByte(GetHL(), value);
 }
 
-void CPU::OP_BA() {
-    uint8_t result = registers[A] - registers[D];
-    UFARA(result, registers[A], registers[D], true);
-    pc += 1;
+template<uint8_t dst, uint8_t src>
+void CPU::LD()
+{
+    WriteR8<dst>(ReadR8<src>());
+    pc += (src == IMM8) ? 2 : 1;
 }
 
-void CPU::OP_BB() {
-    uint8_t result = registers[A] - registers[E];
-    UFARA(result, registers[A], registers[E], true);
-    pc += 1;
+template<uint8_t op, uint8_t r>
+void CPU::ALU()
+{
+    uint8_t a = registers[A];
+    uint8_t value = ReadR8<r>();
+    uint8_t carry = (op == ALU_ADC || op == ALU_SBC) ? CarryFlag() : 0;
+
+    switch (op) {
+    case ALU_ADD:
+    case ALU_ADC:
+        registers[A] = Add8(a, value, carry);
+        break;
+    case ALU_SUB:
+    case ALU_SBC:
+        registers[A] = Sub8(a, value, carry);
+        break;
+    case ALU_CP:
+        Sub8(a, value, 0); // CP only sets the flags
+        break;
+    case ALU_AND:
+        registers[A] = a & value;
+        UFAAO(registers[A]);
+        break;
+    case ALU_XOR:
+        registers[A] = a ^ value;
+        UFAOXO(registers[A]);
+        break;
+    case ALU_OR:
+        registers[A] = a | value;
+        UFAOXO(registers[A]);
+        break;
+    }
+
+    pc += (r == IMM8) ? 2 : 1;
 }
 
-void CPU::OP_BC() {
-    uint8_t result = registers[A] - registers[H];
-    UFARA(result, registers[A], registers[H], true);
+template<uint8_t r>
+void CPU::INC()
+{
+    WriteR8<r>(Inc8(ReadR8<r>()));
     pc += 1;
 }
 
-void CPU::OP_BD() {
-    uint8_t result = registers[A] - registers[L];
-    UFARA(result, registers[A], registers[L], true);
+template<uint8_t r>
+void CPU::DEC()
+{
+    WriteR8<r>(Dec8(ReadR8<r>()));
     pc += 1;
 }
 
-void CPU::OP_BE() {
-    uint8_t result = registers[A] - memory[GetHL()];
-    UFARA(result, registers[A], memory[GetHL()], true);
-    pc += 1;
+// CB handlers don't touch the pc, Cycle() steps over the prefix and the opcode
+template<uint8_t op, uint8_t bit, uint8_t r>
+void CPU::CB()
+{
+    uint8_t value = ReadR8<r>();
+    const uint8_t mask = static_cast<uint8_t>(1 << bit);
+
+    switch (op) {
+    case CB_BIT:
+        SetFlags(((value & mask) == 0 ? FLAG_Z : 0) | FLAG_H | (CarryFlag() ? FLAG_C : 0));
+        return; // BIT doesn't write anything back
+    case CB_RES:
+        WriteR8<r>(value & ~mask);
+        return;
+    case CB_SET:
+        WriteR8<r>(value | mask);
+        return;
+    }
+
+    // CB_SHIFT, bit picks which shift it is
+    uint8_t result;
+    bool carryOut;
+
+    switch (bit) {
+    case SH_RLC: carryOut = (value & 0x80) != 0; result = (value << 1) | (value >> 7); break;
+    case SH_RRC: carryOut = (value & 0x01) != 0; result = (value >> 1) | (value << 7); break;
+    case SH_RL: carryOut = (value & 0x80) != 0; result = (value << 1) | CarryFlag(); break;
+    case SH_RR: carryOut = (value & 0x01) != 0; result = (value >> 1) | (CarryFlag() << 7); break;
+    case SH_SLA: carryOut = (value & 0x80) != 0; result = value << 1; break;
+    case SH_SRA: carryOut = (value & 0x01) != 0; result = (value >> 1) | (value & 0x80); break;
+    case SH_SWAP: carryOut = false; result = (value << 4) | (value >> 4); break;
+    default: carryOut = (value & 0x01) != 0; result = value >> 1; break; // SH_SRL
+    }
+
+    WriteR8<r>(result);
+
+    SetFlags((result == 0 ? FLAG_Z : 0) | (carryOut ? FLAG_C : 0));
 }
+#pragma endregion
 
-void CPU::OP_BF() {
-    uint8_t result = registers[A] - registers[A];
-    UFARA(result, registers[A], registers[A], true);
+void CPU::OP_76() {
+    halted = true;
     pc += 1;
 }
 
@@ -1477,7 +518,7 @@ void CPU::OP_C1() {
 void CPU::OP_C2() {
     if (!GetFlag(FLAG_Z))
     {
-        uint16_t offset = (this->*addressModeTable[2])();
+        uint16_t offset = Imm16();
         pc += offset;
     }
     else 
@@ -1487,7 +528,7 @@ void CPU::OP_C2() {
 }
 
 void CPU::OP_C3() {
-    uint16_t offset = (this->*addressModeTable[2])();
+    uint16_t offset = Imm16();
     pc += offset;
 }
 
@@ -1497,7 +538,7 @@ void CPU::OP_C4() {
         uint16_t returnaddr = pc + 3;
         PushToStack(returnaddr);
 
-        uint16_t addr = (this->*addressModeTable[2])();
+        uint16_t addr = Imm16();
         pc = addr;
     }
     else
@@ -1511,13 +552,6 @@ void CPU::OP_C5() {
     pc += 1;
 }
 
-void CPU::OP_C6() {
-    uint8_t op2 = (this->*addressModeTable[0])();
-    uint16_t result = registers[A] += op2;
-    UFARA(result, registers[A], op2, false);
-    pc += 2;
-}
-
 void CPU::OP_C7() {
     PushToStack(pc);
     pc = 0x0000;
@@ -1542,7 +576,7 @@ void CPU::OP_C9()
 void CPU::OP_CA() {
     if (GetFlag(FLAG_Z)) 
     {
-        uint16_t offset = (this->*addressModeTable[2])();
+        uint16_t offset = Imm16();
         pc += offset;
     }
     else
@@ -1557,7 +591,7 @@ void CPU::OP_CC() {
         uint16_t returnaddr = pc + 3;
         PushToStack(returnaddr);
 
-        uint16_t addr = (this->*addressModeTable[2])();
+        uint16_t addr = Imm16();
         pc = addr;
     }
     else
@@ -1570,27 +604,10 @@ void CPU::OP_CD() {
     uint16_t returnaddr = pc + 3;
     PushToStack(returnaddr);
 
-    uint16_t addr = (this->*addressModeTable[2])();
+    uint16_t addr = Imm16();
     pc = addr;
 }
 
-void CPU::OP_CE() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t op2 = (this->*addressModeTable[0])();
-    uint8_t result = registers[A] + op2 + carry;
-
-    registers[A] = result & 0xFF;
-
-    SetFlag(FLAG_Z, registers[A] == 0);
-    SetFlag(FLAG_N, false);
-
-    bool halfcarry = ((registers[A] & 0x0F) + (op2 & 0x0F) + carry) > 0x0F;
-    SetFlag(FLAG_H, halfcarry);
-
-    SetFlag(FLAG_C, result > 0xFF);
-    pc += 1;
-}
-
 void CPU::OP_CF() {
     PushToStack(pc);
     pc = 0x08;
@@ -1615,7 +632,7 @@ void CPU::OP_D1() {
 void CPU::OP_D2() {
     if (!GetFlag(FLAG_C))
     {
-        uint16_t offset = (this->*addressModeTable[2])();
+        uint16_t offset = Imm16();
         pc += offset;
     }
     else
@@ -1625,7 +642,7 @@ void CPU::OP_D2() {
 }
 
 void CPU::OP_D3() {
-    io_port[registers[C]] = registers[A];
+    WriteByte(0xFF00 | registers[C], registers[A]); // the I/O ports are the registers at 0xFF00
     pc += 1;
 }
 
@@ -1635,7 +652,7 @@ void CPU::OP_D4() {
         uint16_t returnaddr = pc + 3;
         PushToStack(returnaddr);
 
-        uint16_t addr = (this->*addressModeTable[2])();
+        uint16_t addr = Imm16();
         pc = addr;
     }
     else
@@ -1649,13 +666,6 @@ void CPU::OP_D5() {
     pc += 1;
 }
 
-void CPU::OP_D6() {
-    uint8_t op2 = (this->*addressModeTable[0])();
-    uint16_t result = registers[A] += op2;
-    UFARA(result, registers[A], op2, true);
-    pc += 2;
-}
-
 void CPU::OP_D7() {
     PushToStack(pc);
     pc = 0x0010;
@@ -1680,7 +690,7 @@ void CPU::OP_D9() {
 void CPU::OP_DA() {
     if (GetFlag(FLAG_C))
     {
-        uint16_t offset = (this->*addressModeTable[2])();
+        uint16_t offset = Imm16();
         pc += offset;
     }
     else
@@ -1690,7 +700,7 @@ void CPU::OP_DA() {
 }
 
 void CPU::OP_DB() {
-    registers[A] = io_port[registers[C]];
+    registers[A] = ReadByte(0xFF00 | registers[C]);
     pc += 1;
 }
 
@@ -1700,7 +710,7 @@ void CPU::OP_DC() {
         uint16_t returnaddr = pc + 3;
         PushToStack(returnaddr);
 
-        uint16_t addr = (this->*addressModeTable[2])();
+        uint16_t addr = Imm16();
         pc = addr;
     }
     else
@@ -1714,37 +724,15 @@ void CPU::OP_DD()
     pc += 1;
 }
 
-void CPU::OP_DE() {
-    uint8_t carry = GetFlag(FLAG_C) ? 1 : 0;
-    uint8_t op2 = (this->*addressModeTable[0])();
-    uint8_t result = registers[A] - op2 - carry;
-
-    registers[A] = result;
-
-    // Set the Zero flag
-    SetFlag(FLAG_Z, registers[A] == 0);
-    // Set the Subtract (N) flag
-    SetFlag(FLAG_N, true);
-
-    // Set the Half-Carry (H) flag
-    bool halfcarry = ((registers[A] & 0x0F) < (op2 & 0x0F) + carry);
-    SetFlag(FLAG_H, halfcarry);
-
-    // Set the Carry (C) flag
-    SetFlag(FLAG_C, (result > 0xFF));
-
-    pc += 1;
-}
-
 void CPU::OP_DF() {
     PushToStack(pc);
     pc = 0x18;
 }
 
 void CPU::OP_E0() {
-    uint8_t val = (this->*addressModeTable[0])();
+    uint8_t val = Imm8();
     uint16_t addr = 0xFF00 + val;
-    memory[addr] = registers[A];
+    WriteByte(addr, registers[A]);
     pc += 2;
 }
 
@@ -1754,8 +742,8 @@ void CPU::OP_E1() {
 }
 
 void CPU::OP_E2() {
-    memory[registers[C]] = registers[A];
-    pc += 2;
+    WriteByte(0xFF00 | registers[C], registers[A]);
+    pc += 1;
 }
 
 void CPU::OP_E3()
@@ -1773,19 +761,13 @@ void CPU::OP_E5() {
     pc += 1;
 }
 
-void CPU::OP_E6() {
-    uint8_t val = (this->*addressModeTable[0])();
-    registers[A] &= val;
-    pc += 2;
-}
-
 void CPU::OP_E7() {
     PushToStack(pc);
     pc = 0x0020;
 }
 
 void CPU::OP_E8() {
-    int8_t immediateValue = static_cast<int8_t>(memory[pc + 1]); // use this since I need to fetch a signed int
+    int8_t immediateValue = static_cast<int8_t>(Imm8()); // use this since I need to fetch a signed int
     uint16_t originalSP = sp;
 
     sp = sp + immediateValue;
@@ -1806,8 +788,8 @@ void CPU::OP_E9() {
 }
 
 void CPU::OP_EA() {
-    uint16_t addr = (this->*addressModeTable[2])();
-    memory[addr] = registers[A];
+    uint16_t addr = Imm16();
+    WriteByte(addr, registers[A]);
     pc += 3;
 }
 
@@ -1826,20 +808,14 @@ void CPU::OP_ED()
     pc += 1;
 }
 
-void CPU::OP_EE() {
-    uint8_t val = (this->*addressModeTable[0])();
-    registers[A] ^= val;
-    pc += 2;
-}
-
 void CPU::OP_EF() {
     PushToStack(pc);
     pc = 0x0028;
 }
 
 void CPU::OP_F0() {
-    uint8_t val = (this->*addressModeTable[0])();
-    registers[A] = memory[val];
+    uint8_t val = Imm8();
+    registers[A] = ReadByte(0xFF00 | val);
     pc += 2;
 }
 
@@ -1849,8 +825,8 @@ void CPU::OP_F1() {
 }
 
 void CPU::OP_F2() {
-    registers[A] = memory[registers[C]];
-    pc += 2;
+    registers[A] = ReadByte(0xFF00 | registers[C]);
+    pc += 1;
 }
 
 void CPU::OP_F3() {
@@ -1867,20 +843,13 @@ void CPU::OP_F5() {
     pc += 1;
 }
 
-void CPU::OP_F6() {
-    uint8_t val = (this->*addressModeTable[0])();
-    uint16_t result = registers[A] |= val;
-    UFAOXO(result);
-    pc += 2;
-}
-
 void CPU::OP_F7() {
     PushToStack(pc);
     pc = 0x0030;
 }
 
 void CPU::OP_F8() {
-    int8_t offset = (int8_t)memory[pc + 1];
+    int8_t offset = (int8_t)Imm8();
 
     uint16_t result = sp + offset;
 
@@ -1904,7 +873,7 @@ void CPU::OP_F9() {
 }
 
 void CPU::OP_FA() {
-    uint16_t val = (this->*addressModeTable[2])();
+    uint16_t val = Imm16();
     registers[A] = val;
     pc += 3; 
 }
@@ -1922,30 +891,315 @@ void CPU::OP_FD() {
     pc += 1;
 }
 
-void CPU::OP_FE() {
-    uint8_t val = (this->*addressModeTable[0])();
-    val = ~val;
-    pc += 2;
-}
-
 void CPU::OP_FF() {
     PushToStack(pc);
     pc = 0x0038;
 }
 
-void CPU::CB_00() {}
-void CPU::CB_01() {}
-void CPU::CB_02() {}
-void CPU::CB_03() {}
-void CPU::CB_04() {}
-void CPU::CB_05() {}
-void CPU::CB_06() {}
-void CPU::CB_07() {}
-void CPU::CB_08() {}
-void CPU::CB_09() {}
-void CPU::CB_0A() {}
-void CPU::CB_0B() {}
-void CPU::CB_0C() {}
-void CPU::CB_0D() {}
-void CPU::CB_0E() {}
-void CPU::CB_0F() {}
+#pragma region compile_time_tables
+template<uint8_t op>
+constexpr CPU::CPUFunc CPU::GeneratedHandler()
+{
+    return (op >= 0x40 && op < 0x80 && op != 0x76) ? &CPU::LD<RegFromCode((op >> 3) & 7), RegFromCode(op & 7)>
+        : (op >= 0x80 && op < 0xC0) ? &CPU::ALU<(op >> 3) & 7, RegFromCode(op & 7)>
+        : ((op & 0xC7) == 0xC6) ? &CPU::ALU<(op >> 3) & 7, IMM8>
+        : ((op & 0xC7) == 0x04) ? &CPU::INC<RegFromCode((op >> 3) & 7)>
+        : ((op & 0xC7) == 0x05) ? &CPU::DEC<RegFromCode((op >> 3) & 7)>
+        : ((op & 0xC7) == 0x06) ? &CPU::LD<RegFromCode((op >> 3) & 7), IMM8>
+        : nullptr;
+}
+
+template<size_t... ops>
+constexpr CPU::OpcodeTable CPU::MakeMainTable(std::index_sequence<ops...>)
+{
+    OpcodeTable table{ { GeneratedHandler<ops>()... } };
+
+    // Everything that isn't generated starts out as OP_NULL to handle unimplemented opcodes
+    for (int i = 0; i < 256; i++) {
+        if (table.op[i] == nullptr) {
+            table.op[i] = &CPU::OP_NULL;
+        }
+    }
+
+    // Hand written opcodes
+    table.op[0x00] = &CPU::OP_00; // NOP
+    table.op[0x01] = &CPU::OP_01; // LD BC,nn
+    table.op[0x02] = &CPU::OP_02; // LD (BC),A
+    table.op[0x03] = &CPU::OP_03; // INC BC
+    table.op[0x07] = &CPU::OP_07; // RLCA
+    table.op[0x08] = &CPU::OP_08; // LD (nn),SP
+    table.op[0x09] = &CPU::OP_09; // ADD HL,BC
+    table.op[0x0A] = &CPU::OP_0A; // LD A,(BC)
+    table.op[0x0B] = &CPU::OP_0B; // DEC BC
+    table.op[0x0F] = &CPU::OP_0F; // RRCA
+    table.op[0x10] = &CPU::OP_10; // STOP 0
+    table.op[0x11] = &CPU::OP_11; // LD DE, d16
+    table.op[0x12] = &CPU::OP_12; // LD (DE), A
+    table.op[0x13] = &CPU::OP_13; // INC DE
+    table.op[0x17] = &CPU::OP_17; // RLA
+    table.op[0x18] = &CPU::OP_18; // JR r8 
+    table.op[0x19] = &CPU::OP_19; // ADD HL, DE
+    table.op[0x1A] = &CPU::OP_1A; // LD A, (DE)
+    table.op[0x1B] = &CPU::OP_1B; // DEC DE
+    table.op[0x1F] = &CPU::OP_1F; // RRA
+    table.op[0x20] = &CPU::OP_20; // JR NZ, r8
+    table.op[0x21] = &CPU::OP_21; // LD HL, d16
+    table.op[0x22] = &CPU::OP_22; // LD (HL+), A
+    table.op[0x23] = &CPU::OP_23; // INC HL
+    table.op[0x27] = &CPU::OP_27; // DAA
+    table.op[0x28] = &CPU::OP_28; // JR Z, r8
+    table.op[0x29] = &CPU::OP_29; // ADD HL, HL
+    table.op[0x2A] = &CPU::OP_2A; // LD A, (HL+)
+    table.op[0x2B] = &CPU::OP_2B; // DEC HL
+    table.op[0x2F] = &CPU::OP_2F; // CPL
+    table.op[0x30] = &CPU::OP_30; // JR NC, r8
+    table.op[0x31] = &CPU::OP_31; // LD SP, d16
+    table.op[0x32] = &CPU::OP_32; // not even going to bother putting comments here anymore 
+    table.op[0x33] = &CPU::OP_33;
+    table.op[0x37] = &CPU::OP_37;
+    table.op[0x38] = &CPU::OP_38;
+    table.op[0x39] = &CPU::OP_39;
+    table.op[0x3A] = &CPU::OP_3A;
+    table.op[0x3B] = &CPU::OP_3B;
+    table.op[0x3F] = &CPU::OP_3F;
+    table.op[0x76] = &CPU::OP_76; // HALT
+    table.op[0xC0] = &CPU::OP_C0; // RET NZ
+    table.op[0xC1] = &CPU::OP_C1; // POP BC
+    table.op[0xC2] = &CPU::OP_C2; // JP NZ, a16
+    table.op[0xC3] = &CPU::OP_C3; // JP a16
+    table.op[0xC4] = &CPU::OP_C4; // CALL NZ, a16
+    table.op[0xC5] = &CPU::OP_C5; // PUSH BC
+    table.op[0xC7] = &CPU::OP_C7; // RST 00H
+    table.op[0xC8] = &CPU::OP_C8; // RET Z
+    table.op[0xC9] = &CPU::OP_C9; // RET
+    table.op[0xCA] = &CPU::OP_CA; // JP Z, a16
+  //table.op[0xCB] = &CPU::OP_CB; // PREFIX CB not needed
+    table.op[0xCC] = &CPU::OP_CC; // CALL Z, a16
+    table.op[0xCD] = &CPU::OP_CD; // CALL a16
+    table.op[0xCF] = &CPU::OP_CF; // RST 08H
+    table.op[0xD0] = &CPU::OP_D0; // RET NC
+    table.op[0xD1] = &CPU::OP_D1; // POP DE
+    table.op[0xD2] = &CPU::OP_D2; // JP NC, a16
+    table.op[0xD3] = &CPU::OP_D3; // OUT (C), A
+    table.op[0xD4] = &CPU::OP_D4; // CALL NC, a16
+    table.op[0xD5] = &CPU::OP_D5; // PUSH DE
+    table.op[0xD7] = &CPU::OP_D7; // RST 10H
+    table.op[0xD8] = &CPU::OP_D8; // RET C
+    table.op[0xD9] = &CPU::OP_D9; // RETI
+    table.op[0xDA] = &CPU::OP_DA; // JP C, a16
+    table.op[0xDB] = &CPU::OP_DB; // IN A, (C)
+    table.op[0xDC] = &CPU::OP_DC; // CALL C, a16
+    table.op[0xDD] = &CPU::OP_DD; // NOP IX/IY opcodes not needed
+    table.op[0xDF] = &CPU::OP_DF; // RST 18H
+    table.op[0xE0] = &CPU::OP_E0; // LD (a8), A
+    table.op[0xE1] = &CPU::OP_E1; // POP HL
+    table.op[0xE2] = &CPU::OP_E2; // LD (C), A
+    table.op[0xE3] = &CPU::OP_E3; // NOP
+    table.op[0xE4] = &CPU::OP_E4; // NOP
+    table.op[0xE5] = &CPU::OP_E5; // PUSH HL
+    table.op[0xE7] = &CPU::OP_E7; // RST 20H
+    table.op[0xE8] = &CPU::OP_E8; // ADD SP, r8
+    table.op[0xE9] = &CPU::OP_E9; // JP (HL)
+    table.op[0xEA] = &CPU::OP_EA; // LD (a16), A
+    table.op[0xEB] = &CPU::OP_EB; // NOP
+    table.op[0xEC] = &CPU::OP_EC; // NOP
+    table.op[0xED] = &CPU::OP_ED; // NOP
+    table.op[0xEF] = &CPU::OP_EF; // RST 28H
+    table.op[0xF0] = &CPU::OP_F0; // LD A, (a8)
+    table.op[0xF1] = &CPU::OP_F1; // POP AF
+    table.op[0xF2] = &CPU::OP_F2; // LD A, (C)
+    table.op[0xF3] = &CPU::OP_F3; // DI
+    table.op[0xF4] = &CPU::OP_F4; // NOP
+    table.op[0xF5] = &CPU::OP_F5; // PUSH AF
+    table.op[0xF7] = &CPU::OP_F7; // RST 30H
+    table.op[0xF8] = &CPU::OP_F8; // LD HL, SP+r8
+    table.op[0xF9] = &CPU::OP_F9; // LD SP, HL
+    table.op[0xFA] = &CPU::OP_FA; // LD A, (a16)
+    table.op[0xFB] = &CPU::OP_FB; // EI
+    table.op[0xFC] = &CPU::OP_FC; // NOP
+    table.op[0xFD] = &CPU::OP_FD; // NOP
+    table.op[0xFF] = &CPU::OP_FF; // RST 38H
+
+    return table;
+}
+
+template<size_t... ops>
+constexpr CPU::OpcodeTable CPU::MakeCBTable(std::index_sequence<ops...>)
+{
+    return OpcodeTable{ { &CPU::CB<(ops >> 6), (ops >> 3) & 7, RegFromCode(ops & 7)>... } };
+}
+
+const CPU::OpcodeTable CPU::mainTable = CPU::MakeMainTable(std::make_index_sequence<256>());
+const CPU::OpcodeTable CPU::cbTable = CPU::MakeCBTable(std::make_index_sequence<256>());
+#pragma endregion
+
+// Every main opcode with the kind of handler it uses (0xCB is the prefix and handled by the caller)
+#define MAIN_OPCODES(X) \
+    X(00, OP) X(01, OP) X(02, OP) X(03, OP) X(04, INC) X(05, DEC) X(06, LDI) X(07, OP) \
+    X(08, OP) X(09, OP) X(0A, OP) X(0B, OP) X(0C, INC) X(0D, DEC) X(0E, LDI) X(0F, OP) \
+    X(10, OP) X(11, OP) X(12, OP) X(13, OP) X(14, INC) X(15, DEC) X(16, LDI) X(17, OP) \
+    X(18, OP) X(19, OP) X(1A, OP) X(1B, OP) X(1C, INC) X(1D, DEC) X(1E, LDI) X(1F, OP) \
+    X(20, OP) X(21, OP) X(22, OP) X(23, OP) X(24, INC) X(25, DEC) X(26, LDI) X(27, OP) \
+    X(28, OP) X(29, OP) X(2A, OP) X(2B, OP) X(2C, INC) X(2D, DEC) X(2E, LDI) X(2F, OP) \
+    X(30, OP) X(31, OP) X(32, OP) X(33, OP) X(34, INC) X(35, DEC) X(36, LDI) X(37, OP) \
+    X(38, OP) X(39, OP) X(3A, OP) X(3B, OP) X(3C, INC) X(3D, DEC) X(3E, LDI) X(3F, OP) \
+    X(40, LD) X(41, LD) X(42, LD) X(43, LD) X(44, LD) X(45, LD) X(46, LD) X(47, LD) \
+    X(48, LD) X(49, LD) X(4A, LD) X(4B, LD) X(4C, LD) X(4D, LD) X(4E, LD) X(4F, LD) \
+    X(50, LD) X(51, LD) X(52, LD) X(53, LD) X(54, LD) X(55, LD) X(56, LD) X(57, LD) \
+    X(58, LD) X(59, LD) X(5A, LD) X(5B, LD) X(5C, LD) X(5D, LD) X(5E, LD) X(5F, LD) \
+    X(60, LD) X(61, LD) X(62, LD) X(63, LD) X(64, LD) X(65, LD) X(66, LD) X(67, LD) \
+    X(68, LD) X(69, LD) X(6A, LD) X(6B, LD) X(6C, LD) X(6D, LD) X(6E, LD) X(6F, LD) \
+    X(70, LD) X(71, LD) X(72, LD) X(73, LD) X(74, LD) X(75, LD) X(76, OP) X(77, LD) \
+    X(78, LD) X(79, LD) X(7A, LD) X(7B, LD) X(7C, LD) X(7D, LD) X(7E, LD) X(7F, LD) \
+    X(80, ALU) X(81, ALU) X(82, ALU) X(83, ALU) X(84, ALU) X(85, ALU) X(86, ALU) X(87, ALU) \
+    X(88, ALU) X(89, ALU) X(8A, ALU) X(8B, ALU) X(8C, ALU) X(8D, ALU) X(8E, ALU) X(8F, ALU) \
+    X(90, ALU) X(91, ALU) X(92, ALU) X(93, ALU) X(94, ALU) X(95, ALU) X(96, ALU) X(97, ALU) \
+    X(98, ALU) X(99, ALU) X(9A, ALU) X(9B, ALU) X(9C, ALU) X(9D, ALU) X(9E, ALU) X(9F, ALU) \
+    X(A0, ALU) X(A1, ALU) X(A2, ALU) X(A3, ALU) X(A4, ALU) X(A5, ALU) X(A6, ALU) X(A7, ALU) \
+    X(A8, ALU) X(A9, ALU) X(AA, ALU) X(AB, ALU) X(AC, ALU) X(AD, ALU) X(AE, ALU) X(AF, ALU) \
+    X(B0, ALU) X(B1, ALU) X(B2, ALU) X(B3, ALU) X(B4, ALU) X(B5, ALU) X(B6, ALU) X(B7, ALU) \
+    X(B8, ALU) X(B9, ALU) X(BA, ALU) X(BB, ALU) X(BC, ALU) X(BD, ALU) X(BE, ALU) X(BF, ALU) \
+    X(C0, OP) X(C1, OP) X(C2, OP) X(C3, OP) X(C4, OP) X(C5, OP) X(C6, ALUI) X(C7, OP) \
+    X(C8, OP) X(C9, OP) X(CA, OP) X(CC, OP) X(CD, OP) X(CE, ALUI) X(CF, OP) X(D0, OP) \
+    X(D1, OP) X(D2, OP) X(D3, OP) X(D4, OP) X(D5, OP) X(D6, ALUI) X(D7, OP) X(D8, OP) \
+    X(D9, OP) X(DA, OP) X(DB, OP) X(DC, OP) X(DD, OP) X(DE, ALUI) X(DF, OP) X(E0, OP) \
+    X(E1, OP) X(E2, OP) X(E3, OP) X(E4, OP) X(E5, OP) X(E6, ALUI) X(E7, OP) X(E8, OP) \
+    X(E9, OP) X(EA, OP) X(EB, OP) X(EC, OP) X(ED, OP) X(EE, ALUI) X(EF, OP) X(F0, OP) \
+    X(F1, OP) X(F2, OP) X(F3, OP) X(F4, OP) X(F5, OP) X(F6, ALUI) X(F7, OP) X(F8, OP) \
+    X(F9, OP) X(FA, OP) X(FB, OP) X(FC, OP) X(FD, OP) X(FE, ALUI) X(FF, OP)
+
+#define CB_OPCODES(X) \
+    X(00) X(01) X(02) X(03) X(04) X(05) X(06) X(07) \
+    X(08) X(09) X(0A) X(0B) X(0C) X(0D) X(0E) X(0F) \
+    X(10) X(11) X(12) X(13) X(14) X(15) X(16) X(17) \
+    X(18) X(19) X(1A) X(1B) X(1C) X(1D) X(1E) X(1F) \
+    X(20) X(21) X(22) X(23) X(24) X(25) X(26) X(27) \
+    X(28) X(29) X(2A) X(2B) X(2C) X(2D) X(2E) X(2F) \
+    X(30) X(31) X(32) X(33) X(34) X(35) X(36) X(37) \
+    X(38) X(39) X(3A) X(3B) X(3C) X(3D) X(3E) X(3F) \
+    X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47) \
+    X(48) X(49) X(4A) X(4B) X(4C) X(4D) X(4E) X(4F) \
+    X(50) X(51) X(52) X(53) X(54) X(55) X(56) X(57) \
+    X(58) X(59) X(5A) X(5B) X(5C) X(5D) X(5E) X(5F) \
+    X(60) X(61) X(62) X(63) X(64) X(65) X(66) X(67) \
+    X(68) X(69) X(6A) X(6B) X(6C) X(6D) X(6E) X(6F) \
+    X(70) X(71) X(72) X(73) X(74) X(75) X(76) X(77) \
+    X(78) X(79) X(7A) X(7B) X(7C) X(7D) X(7E) X(7F) \
+    X(80) X(81) X(82) X(83) X(84) X(85) X(86) X(87) \
+    X(88) X(89) X(8A) X(8B) X(8C) X(8D) X(8E) X(8F) \
+    X(90) X(91) X(92) X(93) X(94) X(95) X(96) X(97) \
+    X(98) X(99) X(9A) X(9B) X(9C) X(9D) X(9E) X(9F) \
+    X(A0) X(A1) X(A2) X(A3) X(A4) X(A5) X(A6) X(A7) \
+    X(A8) X(A9) X(AA) X(AB) X(AC) X(AD) X(AE) X(AF) \
+    X(B0) X(B1) X(B2) X(B3) X(B4) X(B5) X(B6) X(B7) \
+    X(B8) X(B9) X(BA) X(BB) X(BC) X(BD) X(BE) X(BF) \
+    X(C0) X(C1) X(C2) X(C3) X(C4) X(C5) X(C6) X(C7) \
+    X(C8) X(C9) X(CA) X(CB) X(CC) X(CD) X(CE) X(CF) \
+    X(D0) X(D1) X(D2) X(D3) X(D4) X(D5) X(D6) X(D7) \
+    X(D8) X(D9) X(DA) X(DB) X(DC) X(DD) X(DE) X(DF) \
+    X(E0) X(E1) X(E2) X(E3) X(E4) X(E5) X(E6) X(E7) \
+    X(E8) X(E9) X(EA) X(EB) X(EC) X(ED) X(EE) X(EF) \
+    X(F0) X(F1) X(F2) X(F3) X(F4) X(F5) X(F6) X(F7) \
+    X(F8) X(F9) X(FA) X(FB) X(FC) X(FD) X(FE) X(FF)
+
+#define CALL_OP(n) OP_##n()
+#define CALL_LD(n) LD<RegFromCode((0x##n >> 3) & 7), RegFromCode(0x##n & 7)>()
+#define CALL_LDI(n) LD<RegFromCode((0x##n >> 3) & 7), IMM8>()
+#define CALL_ALU(n) ALU<(0x##n >> 3) & 7, RegFromCode(0x##n & 7)>()
+#define CALL_ALUI(n) ALU<(0x##n >> 3) & 7, IMM8>()
+#define CALL_INC(n) INC<RegFromCode((0x##n >> 3) & 7)>()
+#define CALL_DEC(n) DEC<RegFromCode((0x##n >> 3) & 7)>()
+#define CALL_CB(n) CB<(0x##n >> 6), (0x##n >> 3) & 7, RegFromCode(0x##n & 7)>()
+
+// Switch core: every handler gets its own case so the compiler can inline the body
+// and the host branch predictor gets one dispatch site per opcode instead of one shared indirect call.
+#define OP_CASE(n, kind) case 0x##n: CALL_##kind(n); break;
+#define CB_CASE(n) case 0x##n: CALL_CB(n); break;
+
+void CPU::ExecuteMain(uint8_t op)
+{
+    switch (op) {
+    MAIN_OPCODES(OP_CASE)
+    default: OP_NULL(); break;
+    }
+}
+
+void CPU::ExecuteCB(uint8_t op)
+{
+    switch (op) {
+    CB_OPCODES(CB_CASE)
+    }
+}
+
+#undef OP_CASE
+#undef CB_CASE
+
+#if GB_CORE == GB_CORE_THREADED
+// Threaded core: each handler ends in its own copy of the fetch + indirect jump.
+// Runs until the deadline has passed or the cpu halts/stops, Cycle() deals with those.
+#define DISPATCH() \
+    TRACE_INSTRUCTION(); \
+    FetchInstruction(); \
+    goto *mainLabels[opcode];
+
+#define NEXT() \
+    cycles += opcodeCycles[opcode]; \
+    if (halted || stopped || cycles >= runDeadline) return; \
+    DISPATCH()
+
+#define OP_LABEL(n, kind) op_##n: CALL_##kind(n); NEXT()
+
+void CPU::RunThreaded()
+{
+    static void* const mainLabels[256] = {
+        &&op_00, &&op_01, &&op_02, &&op_03, &&op_04, &&op_05, &&op_06, &&op_07,
+        &&op_08, &&op_09, &&op_0A, &&op_0B, &&op_0C, &&op_0D, &&op_0E, &&op_0F,
+        &&op_10, &&op_11, &&op_12, &&op_13, &&op_14, &&op_15, &&op_16, &&op_17,
+        &&op_18, &&op_19, &&op_1A, &&op_1B, &&op_1C, &&op_1D, &&op_1E, &&op_1F,
+        &&op_20, &&op_21, &&op_22, &&op_23, &&op_24, &&op_25, &&op_26, &&op_27,
+        &&op_28, &&op_29, &&op_2A, &&op_2B, &&op_2C, &&op_2D, &&op_2E, &&op_2F,
+        &&op_30, &&op_31, &&op_32, &&op_33, &&op_34, &&op_35, &&op_36, &&op_37,
+        &&op_38, &&op_39, &&op_3A, &&op_3B, &&op_3C, &&op_3D, &&op_3E, &&op_3F,
+        &&op_40, &&op_41, &&op_42, &&op_43, &&op_44, &&op_45, &&op_46, &&op_47,
+        &&op_48, &&op_49, &&op_4A, &&op_4B, &&op_4C, &&op_4D, &&op_4E, &&op_4F,
+        &&op_50, &&op_51, &&op_52, &&op_53, &&op_54, &&op_55, &&op_56, &&op_57,
+        &&op_58, &&op_59, &&op_5A, &&op_5B, &&op_5C, &&op_5D, &&op_5E, &&op_5F,
+        &&op_60, &&op_61, &&op_62, &&op_63, &&op_64, &&op_65, &&op_66, &&op_67,
+        &&op_68, &&op_69, &&op_6A, &&op_6B, &&op_6C, &&op_6D, &&op_6E, &&op_6F,
+        &&op_70, &&op_71, &&op_72, &&op_73, &&op_74, &&op_75, &&op_76, &&op_77,
+        &&op_78, &&op_79, &&op_7A, &&op_7B, &&op_7C, &&op_7D, &&op_7E, &&op_7F,
+        &&op_80, &&op_81, &&op_82, &&op_83, &&op_84, &&op_85, &&op_86, &&op_87,
+        &&op_88, &&op_89, &&op_8A, &&op_8B, &&op_8C, &&op_8D, &&op_8E, &&op_8F,
+        &&op_90, &&op_91, &&op_92, &&op_93, &&op_94, &&op_95, &&op_96, &&op_97,
+        &&op_98, &&op_99, &&op_9A, &&op_9B, &&op_9C, &&op_9D, &&op_9E, &&op_9F,
+        &&op_A0, &&op_A1, &&op_A2, &&op_A3, &&op_A4, &&op_A5, &&op_A6, &&op_A7,
+        &&op_A8, &&op_A9, &&op_AA, &&op_AB, &&op_AC, &&op_AD, &&op_AE, &&op_AF,
+        &&op_B0, &&op_B1, &&op_B2, &&op_B3, &&op_B4, &&op_B5, &&op_B6, &&op_B7,
+        &&op_B8, &&op_B9, &&op_BA, &&op_BB, &&op_BC, &&op_BD, &&op_BE, &&op_BF,
+        &&op_C0, &&op_C1, &&op_C2, &&op_C3, &&op_C4, &&op_C5, &&op_C6, &&op_C7,
+        &&op_C8, &&op_C9, &&op_CA, &&op_CB, &&op_CC, &&op_CD, &&op_CE, &&op_CF,
+        &&op_D0, &&op_D1, &&op_D2, &&op_D3, &&op_D4, &&op_D5, &&op_D6, &&op_D7,
+        &&op_D8, &&op_D9, &&op_DA, &&op_DB, &&op_DC, &&op_DD, &&op_DE, &&op_DF,
+        &&op_E0, &&op_E1, &&op_E2, &&op_E3, &&op_E4, &&op_E5, &&op_E6, &&op_E7,
+        &&op_E8, &&op_E9, &&op_EA, &&op_EB, &&op_EC, &&op_ED, &&op_EE, &&op_EF,
+        &&op_F0, &&op_F1, &&op_F2, &&op_F3, &&op_F4, &&op_F5, &&op_F6, &&op_F7,
+        &&op_F8, &&op_F9, &&op_FA, &&op_FB, &&op_FC, &&op_FD, &&op_FE, &&op_FF,
+    };
+
+    DISPATCH()
+
+    MAIN_OPCODES(OP_LABEL)
+
+op_CB:
+    opcode = ReadByte(++pc);
+    ExecuteCB(static_cast<uint8_t>(opcode));
+    pc += 1; // Move past the CB prefix
+    cycles += cbOpcodeCycles[opcode];
+    if (halted || stopped || cycles >= runDeadline) return;
+    DISPATCH()
+}
+
+#undef OP_LABEL
+#undef NEXT
+#undef DISPATCH
+#endif